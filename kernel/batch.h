@@ -0,0 +1,13 @@
+// Argument to batch(), which makes several system calls
+// in one trap. Both the kernel and user programs use
+// this header file.
+
+struct sysent {
+  int num;             // SYS_* from syscall.h
+  int link;            // if > 0, args[0] is the ret of the entry link places back
+  uint64 args[6];
+  uint64 ret;          // filled in by batch(); -1 if not made
+};
+
+// flags for batch().
+#define BATCH_STOPONERR 1   // stop after the first call that returns -1
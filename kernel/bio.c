@@ -1,6 +1,6 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
@@ -22,70 +22,304 @@
 #include "defs.h"
 #include "fs.h"
 #include "buf.h"
+#include "cachestat.h"
 
-struct {
+// The buffers are hashed by (dev, blockno) into buckets, each
+// with its own lock, so that finding a cached block takes
+// only its bucket's lock. A buffer may be recycled only when
+// its refcnt is 0; then lastuse says when it was released.
+// Recycling one takes bcache.lock as well as bucket locks.
+//
+// Besides the NBUF buffers in bcache.buf, the cache grows by
+// a page of buffers at a time while memory is plentiful
+// (see kmemlow()), and kalloc() takes pages back with
+// bshrink() when memory runs out.
+//
+// Under BCACHE_2Q, which buffer to recycle follows the 2Q
+// policy (Johnson and Shasha, VLDB '94): a block starts out
+// cold, and cold buffers are recycled first in, first out,
+// as long as they fill more than a quarter of the cache.
+// bcache.ghost remembers some recycled cold blocks; one that
+// is read again soon comes back hot, and hot buffers are
+// recycled LRU. A big sequential read thus recycles its own
+// blocks rather than hot ones such as the bitmap, inodes and
+// directories.
+#define NBUCKET 13
+#define MAXBUF  FSSIZE  // no use caching more blocks than the disk has
+#define NGHOST  1024
+
+struct bucket {
   struct spinlock lock;
-  struct buf buf[NBUF];
+  struct buf *head;    // chain through buf.next
+};
 
-  // Linked list of all buffers, through prev/next.
-  // Sorted by how recently the buffer was used.
-  // head.next is most recent, head.prev is least.
-  struct buf head;
+#define BUFPERPAGE ((PGSIZE - sizeof(void*)) / sizeof(struct buf))
+
+struct bufpage {
+  struct bufpage *next;
+  struct buf buf[BUFPERPAGE];
+};
+
+struct {
+  struct spinlock lock;   // serializes recycling, growing and shrinking
+  struct buf buf[NBUF];
+  struct bufpage *pages;  // more buffers, from kalloc()
+  struct buf *free;       // buffers in no bucket, through buf.next
+  uint64 nbuf;
+  uint64 maxbuf;          // grow no bigger than this
+  int nahead;             // references held by reads ahead
+  uint64 nhot;            // hot buffers
+  uint64 nghost;          // misses found in ghost[]
+  uint64 ghost[NGHOST];   // recently recycled cold blocks, as GHOST()
+  int ghostnext;          // where in ghost[] the next one goes
+  struct bucket bucket[NBUCKET];
 } bcache;
 
+#define GHOST(dev, blockno) ((uint64)(dev) << 32 | (blockno))
+
+// Buffer cache event counts, kept per CPU so that counting
+// needs no lock or shared cache line; each CPU's counts are
+// aligned to a cache line of their own. cachestat() adds
+// them up.
+static struct __attribute__((aligned(64))) {
+  uint64 hit;
+  uint64 miss;
+  uint64 recycle;
+  uint64 diskread;
+  uint64 diskwrite;
+  uint64 readahead;
+  uint64 pin;
+  uint64 unpin;
+} bcount[NCPU];
+
+#define BCOUNTN(f, n) do { push_off(); bcount[cpuid()].f += (n); pop_off(); } while(0)
+#define BCOUNT(f) BCOUNTN(f, 1)
+
+static struct bucket*
+bucket(uint dev, uint blockno)
+{
+  return &bcache.bucket[(dev * 31 + blockno) % NBUCKET];
+}
+
 void
 binit(void)
 {
   struct buf *b;
+  struct bucket *bk;
 
   initlock(&bcache.lock, "bcache");
+  for(bk = bcache.bucket; bk < bcache.bucket+NBUCKET; bk++)
+    initlock(&bk->lock, "bcache.bucket");
 
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
   for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
     initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    b->next = bcache.free;
+    bcache.free = b;
   }
+  bcache.nbuf = NBUF;
+  bcache.maxbuf = MAXBUF;
 }
 
-// Look through buffer cache for block on device dev.
-// If not found, allocate a buffer.
-// In either case, return locked buffer.
+// Look for block on device dev in bucket bk, and if it
+// is there, take a reference to it. Counts a hit if stat.
+// Caller must hold bk->lock.
 static struct buf*
-bget(uint dev, uint blockno)
+bfind(struct bucket *bk, uint dev, uint blockno, int stat)
 {
   struct buf *b;
 
-  acquire(&bcache.lock);
-
-  // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
+  for(b = bk->head; b; b = b->next){
     if(b->dev == dev && b->blockno == blockno){
       b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
+      if(stat)
+        BCOUNT(hit);
       return b;
     }
   }
+  return 0;
+}
 
-  // Not cached.
-  // Recycle the least recently used (LRU) unused buffer.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->valid = 0;
-      b->refcnt = 1;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
+// Add a page of buffers to the free list, unless memory
+// is short or the cache is as big as it need be.
+// Caller must hold bcache.lock.
+static void
+bgrow(void)
+{
+  struct bufpage *pg;
+  struct buf *b;
+
+  if(bcache.nbuf + BUFPERPAGE > bcache.maxbuf || kmemlow())
+    return;
+  if((pg = kalloc()) == 0)
+    return;
+  memset(pg, 0, PGSIZE);
+  for(b = pg->buf; b < pg->buf + BUFPERPAGE; b++){
+    initsleeplock(&b->lock, "buffer");
+    b->next = bcache.free;
+    bcache.free = b;
+  }
+  pg->next = bcache.pages;
+  bcache.pages = pg;
+  bcache.nbuf += BUFPERPAGE;
+}
+
+// Should a be recycled before b (which may be 0)?
+static int
+older(struct buf *a, struct buf *b)
+{
+  if(b == 0)
+    return 1;
+  if(BCACHEPOLICY == BCACHE_2Q && !a->hot)
+    return a->loadtime < b->loadtime;
+  return a->lastuse < b->lastuse;
+}
+
+// Remember that the block in b, a cold buffer, was recycled.
+static void
+ghostadd(struct buf *b)
+{
+  bcache.ghost[bcache.ghostnext] = GHOST(b->dev, b->blockno);
+  bcache.ghostnext = (bcache.ghostnext + 1) % NGHOST;
+}
+
+// Was the indicated block recycled not long ago? If so,
+// forget it, since it is about to be cached again.
+static int
+ghosttake(uint dev, uint blockno)
+{
+  uint64 g = GHOST(dev, blockno);
+  int i;
+
+  for(i = 0; i < NGHOST; i++){
+    if(bcache.ghost[i] == g){
+      bcache.ghost[i] = 0;
+      bcache.nghost++;
+      return 1;
     }
   }
-  panic("bget: no buffers");
+  return 0;
+}
+
+// Find a buffer to reuse: a free one if there is or can be
+// one, else an unused buffer chosen by BCACHEPOLICY. Unlink
+// it from its bucket, and return it with refcnt 1, or 0 if
+// every buffer is in use.
+// Caller must hold bcache.lock, and no bucket lock.
+static struct buf*
+brecycle(void)
+{
+  struct bucket *bk, *cbk[2];
+  struct buf *b, **pp, **cpp[2];
+  int h, ncold;
+
+  if(bcache.free == 0)
+    bgrow();
+  if((b = bcache.free) != 0){
+    bcache.free = b->next;
+    b->refcnt = 1;
+    return b;
+  }
+
+  // find the best cold (cpp[0]) and hot (cpp[1]) buffers.
+  // keep their buckets locked, so that no one takes them
+  // meanwhile. only the holder of bcache.lock holds more
+  // than one bucket lock at once.
+  cbk[0] = cbk[1] = 0;
+  cpp[0] = cpp[1] = 0;
+  ncold = 0;
+  for(bk = bcache.bucket; bk < bcache.bucket+NBUCKET; bk++){
+    acquire(&bk->lock);
+    for(pp = &bk->head; *pp; pp = &(*pp)->next){
+      h = (*pp)->hot;
+      if(!h)
+        ncold++;
+      if((*pp)->refcnt == 0 && older(*pp, cpp[h] ? *cpp[h] : 0)){
+        if(cbk[h] && cbk[h] != bk && cbk[h] != cbk[!h])
+          release(&cbk[h]->lock);
+        cbk[h] = bk;
+        cpp[h] = pp;
+      }
+    }
+    if(bk != cbk[0] && bk != cbk[1])
+      release(&bk->lock);
+  }
+
+  // recycle a hot buffer only if cold ones are few.
+  h = cpp[1] && (cpp[0] == 0 || ncold <= bcache.nbuf / 4);
+  if(cpp[h] == 0)
+    return 0;   // and no bucket is locked
+  if(cbk[!h] && cbk[!h] != cbk[h])
+    release(&cbk[!h]->lock);
+
+  b = *cpp[h];
+  *cpp[h] = b->next;
+  b->refcnt = 1;
+  release(&cbk[h]->lock);
+  if(b->valid)
+    BCOUNT(recycle);
+  if(b->hot)
+    bcache.nhot--;
+  else if(BCACHEPOLICY == BCACHE_2Q && b->valid)
+    ghostadd(b);
+  return b;
+}
+
+// Look through buffer cache for block on device dev.
+// If not found, allocate a buffer.
+// In either case, return the buffer with a reference taken,
+// but not locked, or 0 if every buffer is in use. Counts a
+// hit or a miss if stat.
+static struct buf*
+bref(uint dev, uint blockno, int stat)
+{
+  struct bucket *bk = bucket(dev, blockno);
+  struct buf *b;
+
+  // Is the block already cached?
+  acquire(&bk->lock);
+  b = bfind(bk, dev, blockno, stat);
+  release(&bk->lock);
+  if(b)
+    return b;
+
+  // Not cached. Only the holder of bcache.lock adds
+  // buffers to buckets, so look once more with it held,
+  // in case another process added this block meanwhile.
+  acquire(&bcache.lock);
+  acquire(&bk->lock);
+  b = bfind(bk, dev, blockno, stat);
+  if(b == 0 && stat)
+    BCOUNT(miss);
+  release(&bk->lock);
+  if(b == 0 && (b = brecycle()) != 0){
+    b->dev = dev;
+    b->blockno = blockno;
+    b->valid = 0;
+    b->loadtime = r_time();
+    b->hot = BCACHEPOLICY == BCACHE_2Q && ghosttake(dev, blockno);
+    if(b->hot)
+      bcache.nhot++;
+    acquire(&bk->lock);
+    b->next = bk->head;
+    bk->head = b;
+    release(&bk->lock);
+  }
+  release(&bcache.lock);
+  return b;
+}
+
+// Look through buffer cache for block on device dev.
+// If not found, allocate a buffer.
+// In either case, return locked buffer.
+static struct buf*
+bget(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  if((b = bref(dev, blockno, 1)) == 0)
+    panic("bget: no buffers");
+  acquiresleep(&b->lock);
+  return b;
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -96,23 +330,115 @@ bread(uint dev, uint blockno)
 
   b = bget(dev, blockno);
   if(!b->valid) {
+    // waits instead if read-ahead is already reading b.
+    BCOUNT(diskread);
     virtio_disk_rw(b, 0);
     b->valid = 1;
   }
   return b;
 }
 
+// How many more buffers may reads ahead take? They hold
+// their references until the disk is done, and may use no
+// more than a quarter of the cache, so that bread() can
+// always find a buffer.
+int
+breadroom(void)
+{
+  int room = (int)(bcache.maxbuf / 4) - bcache.nahead;
+
+  return room > 0 ? room : 0;
+}
+
+// Start reading the n blocks from blockno on into the cache,
+// if they are not there already, and return without waiting.
+// The disk reads them in as few requests as it can.
+// Returns 0 if it could not start them all, because the disk
+// is busy or reads ahead hold all the buffers they may,
+// else 1.
+int
+breadahead(uint dev, uint blockno, int n)
+{
+  struct buf *bs[DISKRUN];
+  int i, over, r, nread;
+
+  if(n > DISKRUN)
+    n = DISKRUN;
+  // reserve n references within breadroom(), or as many
+  // as are left.
+  over = __sync_add_and_fetch(&bcache.nahead, n) - (int)(bcache.maxbuf / 4);
+  if(over > n)
+    over = n;
+  if(over > 0){
+    __sync_fetch_and_sub(&bcache.nahead, over);
+    n -= over;
+  }
+
+  // the reads hold the references until they are done; the
+  // buffers stay unlocked, so that bread() can wait for them.
+  // stop short rather than wait if no buffer is free.
+  for(i = 0; i < n; i++){
+    if((bs[i] = bref(dev, blockno + i, 0)) == 0){
+      __sync_fetch_and_sub(&bcache.nahead, n - i);
+      over = 1;
+      break;
+    }
+  }
+  if(i == 0)
+    return 0;
+  r = virtio_disk_readahead(bs, i, &nread);
+  BCOUNTN(readahead, nread);
+  return r == 0 && over <= 0;
+}
+
+// Drop a reference taken by breadahead().
+// virtio_disk_readahead() calls this when b's read is done,
+// or at once if b needs no read.
+void
+breaddone(struct buf *b)
+{
+  __sync_fetch_and_sub(&bcache.nahead, 1);
+  bunref(b);
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
 {
   if(!holdingsleep(&b->lock))
     panic("bwrite");
+  BCOUNT(diskwrite);
   virtio_disk_rw(b, 1);
 }
 
+// Start writing the contents of the n buffers in bs to disk,
+// and return without waiting. Runs of consecutive blocks go
+// to the disk together. Each must be locked, and stay locked
+// until bwait() on it returns, so that many writes can be in
+// flight at once.
+void
+bwritev(struct buf **bs, int n)
+{
+  int i;
+
+  for(i = 0; i < n; i++){
+    if(!holdingsleep(&bs[i]->lock))
+      panic("bwritev");
+  }
+  BCOUNTN(diskwrite, n);
+  virtio_disk_submit(bs, n, 1);
+}
+
+// Wait for the disk to finish with b.
+void
+bwait(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("bwait");
+  virtio_disk_wait(b);
+}
+
 // Release a locked buffer.
-// Move to the head of the most-recently-used list.
 void
 brelse(struct buf *b)
 {
@@ -120,34 +446,167 @@ brelse(struct buf *b)
     panic("brelse");
 
   releasesleep(&b->lock);
+  bunref(b);
+}
 
-  acquire(&bcache.lock);
+// Drop a reference to a buffer.
+// If no one else is using it, note when, for LRU.
+void
+bunref(struct buf *b)
+{
+  struct bucket *bk = bucket(b->dev, b->blockno);
+
+  acquire(&bk->lock);
   b->refcnt--;
   if (b->refcnt == 0) {
     // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
-  }
-  
-  release(&bcache.lock);
+    b->lastuse = r_time();
+  }
+  release(&bk->lock);
 }
 
 void
 bpin(struct buf *b) {
-  acquire(&bcache.lock);
+  struct bucket *bk = bucket(b->dev, b->blockno);
+
+  acquire(&bk->lock);
   b->refcnt++;
-  release(&bcache.lock);
+  release(&bk->lock);
+  BCOUNT(pin);
 }
 
 void
 bunpin(struct buf *b) {
-  acquire(&bcache.lock);
+  struct bucket *bk = bucket(b->dev, b->blockno);
+
+  acquire(&bk->lock);
   b->refcnt--;
+  release(&bk->lock);
+  BCOUNT(unpin);
+}
+
+// Take b out of the cache, unless it is in use.
+// Caller must hold bcache.lock.
+static int
+bunlink(struct buf *b)
+{
+  struct bucket *bk;
+  struct buf **pp;
+
+  for(pp = &bcache.free; *pp; pp = &(*pp)->next){
+    if(*pp == b){
+      *pp = b->next;
+      return 1;
+    }
+  }
+  bk = bucket(b->dev, b->blockno);
+  acquire(&bk->lock);
+  if(b->refcnt != 0){
+    release(&bk->lock);
+    return 0;
+  }
+  for(pp = &bk->head; *pp != b; pp = &(*pp)->next)
+    ;
+  *pp = b->next;
+  release(&bk->lock);
+  return 1;
+}
+
+// Put b, which bunlink() took out, back in the cache.
+// Caller must hold bcache.lock.
+static void
+brelink(struct buf *b)
+{
+  struct bucket *bk = bucket(b->dev, b->blockno);
+
+  acquire(&bk->lock);
+  b->next = bk->head;
+  bk->head = b;
+  release(&bk->lock);
+}
+
+// Free a page of buffers that are all unused, to make
+// memory for kalloc(). Returns 1 if it freed one, else 0.
+int
+bshrink(void)
+{
+  struct bufpage *pg, **pp;
+  int i, n, held;
+
+  // bgrow() calls kalloc() with bcache.lock held.
+  push_off();
+  held = holding(&bcache.lock);
+  pop_off();
+  if(held)
+    return 0;
+
+  acquire(&bcache.lock);
+  for(pp = &bcache.pages; (pg = *pp) != 0; pp = &pg->next){
+    for(n = 0; n < BUFPERPAGE; n++)
+      if(!bunlink(&pg->buf[n]))
+        break;
+    if(n == BUFPERPAGE){
+      for(i = 0; i < n; i++)
+        if(pg->buf[i].hot)
+          bcache.nhot--;
+      break;
+    }
+    for(i = 0; i < n; i++)
+      brelink(&pg->buf[i]);
+  }
+  if(pg){
+    *pp = pg->next;
+    bcache.nbuf -= BUFPERPAGE;
+  }
+  release(&bcache.lock);
+
+  if(pg == 0)
+    return 0;
+  kfree(pg);
+  return 1;
+}
+
+// If maxbuf > 0, make it the most buffers the cache may
+// have, shrinking the cache if need be. Returns the limit
+// as it was before.
+int
+bcachelimit(int maxbuf)
+{
+  int old;
+
+  acquire(&bcache.lock);
+  old = bcache.maxbuf;
+  if(maxbuf > 0){
+    if(maxbuf < NBUF)
+      maxbuf = NBUF;
+    if(maxbuf > MAXBUF)
+      maxbuf = MAXBUF;
+    bcache.maxbuf = maxbuf;
+  }
   release(&bcache.lock);
+  while(bcache.nbuf > bcache.maxbuf && bshrink())
+    ;
+  return old;
 }
 
+// Fill in the buffer cache part of *st.
+void
+bcachestat(struct cachestat *st)
+{
+  int i;
 
+  st->nbuf = bcache.nbuf;
+  st->maxbuf = bcache.maxbuf;
+  st->nhot = bcache.nhot;
+  st->bghost = bcache.nghost;
+  for(i = 0; i < NCPU; i++){
+    st->bhit += bcount[i].hit;
+    st->bmiss += bcount[i].miss;
+    st->brecycle += bcount[i].recycle;
+    st->bdiskread += bcount[i].diskread;
+    st->bdiskwrite += bcount[i].diskwrite;
+    st->breadahead += bcount[i].readahead;
+    st->npinned += bcount[i].pin;
+    st->npinned -= bcount[i].unpin;
+  }
+}
@@ -5,8 +5,15 @@ struct buf {
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
-  struct buf *next;
+  uint64 lastuse;   // r_time() when refcnt last fell to 0, for LRU
+  uint64 loadtime;  // r_time() when it got this block
+  int hot;          // BCACHE_2Q: used again soon after being recycled
+  struct buf *next; // hash bucket chain
+  struct buf *dnext; // next buffer in the same disk request
   uchar data[BSIZE];
 };
 
+// Buffer cache replacement policy.
+// Chosen at build time; see BCACHEPOLICY in param.h.
+#define BCACHE_LRU   0  // recycle the least recently used buffer
+#define BCACHE_2Q    1  // keep blocks used more than once through a scan
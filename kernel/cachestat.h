@@ -0,0 +1,29 @@
+// Buffer cache, inode table and disk statistics, from cachestat().
+// Both the kernel and user programs use this header file.
+
+struct cachestat {
+  // buffer cache
+  uint64 nbuf;        // buffers now in the cache
+  uint64 maxbuf;      // most buffers the cache may grow to
+  uint64 npinned;     // buffers pinned by the log
+  uint64 nhot;        // buffers now hot (BCACHE_2Q)
+  uint64 bhit;        // bread()s that found the block cached
+  uint64 bmiss;       // bread()s that did not
+  uint64 brecycle;    // buffers recycled to hold another block
+  uint64 bghost;      // misses on blocks recycled not long ago (BCACHE_2Q)
+  uint64 bdiskread;   // bread()s that waited for the disk
+  uint64 bdiskwrite;  // bwrite()s
+  uint64 breadahead;  // blocks read ahead
+
+  // inode table
+  uint64 ninode;      // entries in the table
+  uint64 iused;       // entries now referenced
+  uint64 ihit;        // iget()s that found the inode in the table
+  uint64 imiss;       // iget()s that did not
+  uint64 irecycle;    // misses that displaced another inode
+
+  // disk
+  uint64 dreq;        // requests sent to the disk
+  uint64 dnotify;     // times the driver told the disk of new requests
+  uint64 dintr;       // disk interrupts
+};
@@ -1,11 +1,16 @@
 struct buf;
+struct cachestat;
 struct context;
 struct file;
 struct inode;
 struct pipe;
 struct proc;
+struct rusage;
+struct sched_attr;
+struct schedlat;
 struct spinlock;
 struct sleeplock;
+struct rwsleeplock;
 struct stat;
 struct superblock;
 
@@ -13,9 +18,18 @@ struct superblock;
 void            binit(void);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
+int             breadahead(uint, uint, int);
+int             breadroom(void);
+void            breaddone(struct buf*);
+void            bunref(struct buf*);
 void            bwrite(struct buf*);
+void            bwritev(struct buf**, int);
+void            bwait(struct buf*);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
+int             bshrink(void);
+void            bcachestat(struct cachestat*);
+int             bcachelimit(int);
 
 // console.c
 void            consoleinit(void);
@@ -42,6 +56,9 @@ struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
 void            iinit();
 void            ilock(struct inode*);
+void            ilockshared(struct inode*);
+uint            ireadahead(struct inode*, uint, uint);
+void            icachestat(struct cachestat*);
 void            iput(struct inode*);
 void            iunlock(struct inode*);
 void            iunlockput(struct inode*);
@@ -54,6 +71,22 @@ void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, int, uint64, uint, uint);
 void            itrunc(struct inode*);
 
+// fpu.c
+void            fpuinit(void);
+void            fpuinithart(void);
+void            fpureset(struct proc*);
+void            fpusync(struct proc*);
+void            fpswitchout(struct proc*);
+int             fpenable(struct proc*);
+
+// futex.c
+void            futexinit(void);
+int             futex(uint64, int, int);
+
+// ipi.c
+void            ipi_send(int, int);
+void            ipiintr(void);
+
 // ramdisk.c
 void            ramdiskinit(void);
 void            ramdiskintr(void);
@@ -63,6 +96,7 @@ void            ramdiskrw(struct buf*);
 void*           kalloc(void);
 void            kfree(void *);
 void            kinit(void);
+int             kmemlow(void);
 
 // log.c
 void            initlog(int, struct superblock*);
@@ -85,8 +119,13 @@ void            printfinit(void);
 int             cpuid(void);
 void            exit(int);
 int             fork(void);
-int             growproc(int);
-void            proc_mapstacks(pagetable_t);
+int             clone(uint64, uint64, uint64);
+int             join(int, uint64);
+void            killthreads(struct proc*);
+uint64          growproc(int);
+void            vmlock(struct proc*);
+void            vmunlock(struct proc*);
+void            tlbshootdown(pagetable_t);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
 int             kill(int);
@@ -101,11 +140,24 @@ void            sched(void);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(uint64);
+int             wait4(int, uint64, int, uint64);
 void            wakeup(void*);
+void            lendweight(struct proc*);
+void            unlendweight(void);
+int             wakeupn(void*, int);
 void            yield(void);
+void            preempt(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
+int             setschedattr(int, struct sched_attr*);
+int             getschedattr(int, struct sched_attr*);
+int             setaffinity(int, uint64);
+int             getaffinity(int, uint64*);
+void            schedyield(void);
+int             dl_timer(uint64, uint64*);
+int             getrusage(int, struct rusage*);
+int             schedlat(int, struct schedlat*, int);
 
 // swtch.S
 void            swtch(struct context*, struct context*);
@@ -116,6 +168,9 @@ int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
 void            release(struct spinlock*);
 void            push_off(void);
+int             lockclass(char*, int);
+void            lockcount(int, int, uint64);
+int             lockstat(uint64, int, int);
 void            pop_off(void);
 
 // sleeplock.c
@@ -123,6 +178,12 @@ void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
+void            acquireread(struct rwsleeplock*);
+void            releaseread(struct rwsleeplock*);
+void            acquirewrite(struct rwsleeplock*);
+void            releasewrite(struct rwsleeplock*);
+int             holdingwrite(struct rwsleeplock*);
+void            initrwsleeplock(struct rwsleeplock*, char*);
 
 // string.c
 int             memcmp(const void*, const void*, uint);
@@ -143,6 +204,7 @@ void            syscall();
 
 // trap.c
 extern uint     ticks;
+extern uint64   boottime;
 void            trapinit(void);
 void            trapinithart(void);
 extern struct spinlock tickslock;
@@ -183,7 +245,11 @@ void            plic_complete(int);
 // virtio_disk.c
 void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *, int);
+void            virtio_disk_submit(struct buf **, int, int);
+void            virtio_disk_wait(struct buf *);
+int             virtio_disk_readahead(struct buf **, int, int *);
 void            virtio_disk_intr(void);
+void            virtio_disk_stat(struct cachestat *);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
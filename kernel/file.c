@@ -22,7 +22,11 @@ struct {
 void
 fileinit(void)
 {
+  struct file *f;
+
   initlock(&ftable.lock, "ftable");
+  for(f = ftable.file; f < ftable.file + NFILE; f++)
+    initsleeplock(&f->offlock, "file");
 }
 
 // Allocate a file structure.
@@ -91,7 +95,7 @@ filestat(struct file *f, uint64 addr)
   struct stat st;
   
   if(f->type == FD_INODE || f->type == FD_DEVICE){
-    ilock(f->ip);
+    ilockshared(f->ip);
     stati(f->ip, &st);
     iunlock(f->ip);
     if(copyout(p->pagetable, addr, (char *)&st, sizeof(st)) < 0)
@@ -101,6 +105,39 @@ filestat(struct file *f, uint64 addr)
   return -1;
 }
 
+// f's reader has just read n bytes at off. If it is reading
+// sequentially, start reading the blocks it will want next,
+// and read further ahead each time (up to READAHEAD blocks),
+// so that the disk stays ahead of it. After a read elsewhere,
+// start over.
+// Caller must hold f->offlock and f->ip->lock.
+static void
+readahead(struct file *f, uint off, int n)
+{
+  uint next;
+
+  if(off != f->raoff){
+    f->raoff = off + n;
+    f->rawin = 0;
+    f->raend = 0;
+    return;
+  }
+  f->raoff = off + n;
+
+  next = (off + n + BSIZE - 1) / BSIZE;
+  if(f->raend < next)
+    f->raend = next;
+  // wait until the reader is half way through what was
+  // read ahead last time.
+  if(f->rawin && f->raend - next > f->rawin / 2)
+    return;
+  if(f->rawin == 0)
+    f->rawin = 4;
+  else if(f->rawin < READAHEAD)
+    f->rawin *= 2;
+  f->raend = ireadahead(f->ip, f->raend, next + f->rawin);
+}
+
 // Read from file f.
 // addr is a user virtual address.
 int
@@ -118,10 +155,16 @@ fileread(struct file *f, uint64 addr, int n)
       return -1;
     r = devsw[f->major].read(1, addr, n);
   } else if(f->type == FD_INODE){
-    ilock(f->ip);
-    if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
+    // the inode lock is only shared, so f->off needs
+    // a lock of its own.
+    acquiresleep(&f->offlock);
+    ilockshared(f->ip);
+    if((r = readi(f->ip, 1, addr, f->off, n)) > 0){
+      readahead(f, f->off, r);
       f->off += r;
+    }
     iunlock(f->ip);
+    releasesleep(&f->offlock);
   } else {
     panic("fileread");
   }
@@ -154,6 +197,7 @@ filewrite(struct file *f, uint64 addr, int n)
     // might be writing a device like the console.
     int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
     int i = 0;
+    acquiresleep(&f->offlock);
     while(i < n){
       int n1 = n - i;
       if(n1 > max)
@@ -172,6 +216,7 @@ filewrite(struct file *f, uint64 addr, int n)
       }
       i += r;
     }
+    releasesleep(&f->offlock);
     ret = (i == n ? n : -1);
   } else {
     panic("filewrite");
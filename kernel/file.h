@@ -6,6 +6,12 @@ struct file {
   struct pipe *pipe; // FD_PIPE
   struct inode *ip;  // FD_INODE and FD_DEVICE
   uint off;          // FD_INODE
+  struct sleeplock offlock; // FD_INODE: serializes reads and writes using off
+
+  // FD_INODE read-ahead, under offlock:
+  uint raoff;        // where the last read ended
+  uint rawin;        // blocks to read ahead; 0 after a non-sequential read
+  uint raend;        // blocks before this one have been read ahead
   short major;       // FD_DEVICE
 };
 
@@ -18,7 +24,7 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
-  struct sleeplock lock; // protects everything below here
+  struct rwsleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
   short type;         // copy of disk inode
@@ -0,0 +1,150 @@
+//
+// Lazy floating-point and vector register switching.
+//
+// A process starts with sstatus.FS and VS Off, so that its
+// first floating-point or vector instruction traps, and
+// fpenable() turns the unit on, loading the process's saved
+// registers from its trapframe unless this CPU still holds
+// them. The hardware then marks the unit Dirty if the
+// process changes a register, and fpswitchout() saves the
+// registers only in that case, before turning the units
+// Off again for whatever runs next. Processes that use only
+// integer registers never pay for any of this.
+//
+// c->fpproc and p->fpcpu together say whether CPU c's
+// registers are p's latest: p may have run and used the
+// unit elsewhere since c last held its registers.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+int hasvector;  // 1 if the CPUs have a usable vector unit
+
+// in fpswtch.S.
+void fpsave(struct trapframe *);
+void fprestore(struct trapframe *);
+void vsave(struct trapframe *);
+void vrestore(struct trapframe *);
+
+// find out whether there is a vector unit whose registers
+// fit in a trapframe. sstatus.VS is read-only zero if the
+// CPU has no vector unit.
+void
+fpuinit(void)
+{
+  uint64 vlenb;
+
+  w_sstatus(r_sstatus() | SSTATUS_VS_CLEAN);
+  if(r_sstatus() & SSTATUS_VS){
+    asm volatile("csrr %0, 0xc22" : "=r" (vlenb));  // vlenb
+    if(vlenb <= MAXVLENB)
+      hasvector = 1;
+    else
+      printf("fpuinit: vlenb %ld too large, no vector support\n", vlenb);
+  }
+}
+
+// turn this CPU's floating-point and vector units Off, so
+// that the first process to use them here traps.
+void
+fpuinithart(void)
+{
+  w_sstatus(r_sstatus() & ~(SSTATUS_FS | SSTATUS_VS));
+}
+
+// Reset p's floating-point and vector registers to zero,
+// for exec(). p must be the current process.
+void
+fpureset(struct proc *p)
+{
+  struct trapframe *tf = p->trapframe;
+
+  memset(tf->f, 0, (char*)(tf + 1) - (char*)tf->f);
+  p->fpcpu = -1;
+  p->vcpu = -1;
+  w_sstatus(r_sstatus() & ~(SSTATUS_FS | SSTATUS_VS));
+}
+
+// Save the current process's live floating-point and
+// vector registers into its trapframe, so that fork()
+// and clone() can copy them.
+void
+fpusync(struct proc *p)
+{
+  uint64 s;
+
+  push_off();
+  s = r_sstatus();
+  if((s & SSTATUS_FS) == SSTATUS_FS_DIRTY){
+    fpsave(p->trapframe);
+    s = (s & ~SSTATUS_FS) | SSTATUS_FS_CLEAN;
+  }
+  if((s & SSTATUS_VS) == SSTATUS_VS_DIRTY){
+    vsave(p->trapframe);
+    s = (s & ~SSTATUS_VS) | SSTATUS_VS_CLEAN;
+  }
+  w_sstatus(s);
+  pop_off();
+}
+
+// Called by sched() as p gives up the CPU, with
+// interrupts off.
+void
+fpswitchout(struct proc *p)
+{
+  struct cpu *c = mycpu();
+  uint64 s = r_sstatus();
+
+  if((s & (SSTATUS_FS | SSTATUS_VS)) == 0)
+    return;
+  if((s & SSTATUS_FS) == SSTATUS_FS_DIRTY)
+    fpsave(p->trapframe);
+  if((s & SSTATUS_VS) == SSTATUS_VS_DIRTY)
+    vsave(p->trapframe);
+  if(s & SSTATUS_FS){
+    c->fpproc = p;
+    p->fpcpu = cpuid();
+  }
+  if(s & SSTATUS_VS){
+    c->vproc = p;
+    p->vcpu = cpuid();
+  }
+  w_sstatus(s & ~(SSTATUS_FS | SSTATUS_VS));
+}
+
+// An illegal instruction trap from user space, with
+// interrupts off. If a unit that the instruction may have
+// needed is Off, turn it on and return 1, so that the
+// instruction is retried. The floating-point unit goes
+// first, since vector floating-point instructions need
+// both. Returns 0 if the instruction is illegal anyway.
+int
+fpenable(struct proc *p)
+{
+  struct cpu *c = mycpu();
+  uint64 s = r_sstatus();
+
+  if((s & SSTATUS_FS) == 0){
+    w_sstatus(s | SSTATUS_FS_CLEAN);
+    if(c->fpproc != p || p->fpcpu != cpuid())
+      fprestore(p->trapframe);
+    c->fpproc = p;
+    p->fpcpu = cpuid();
+    return 1;
+  }
+  if(hasvector && (s & SSTATUS_VS) == 0){
+    w_sstatus(s | SSTATUS_VS_CLEAN);
+    if(c->vproc != p || p->vcpu != cpuid())
+      vrestore(p->trapframe);
+    c->vproc = p;
+    p->vcpu = cpuid();
+    return 1;
+  }
+  return 0;
+}
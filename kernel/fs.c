@@ -20,6 +20,7 @@
 #include "fs.h"
 #include "buf.h"
 #include "file.h"
+#include "cachestat.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 // there should be one superblock per disk device, but we run with
@@ -144,7 +145,10 @@ bfree(int dev, uint b)
 //
 // * Locked: file system code may only examine and modify
 //   the information in an inode and its content if it
-//   has first locked the inode.
+//   has first locked the inode. Code that only examines
+//   them may instead lock it shared with ilockshared(),
+//   so that processes reading the same file, directory or
+//   program at once need not wait for each other.
 //
 // Thus a typical sequence is:
 //   ip = iget(dev, inum)
@@ -169,15 +173,26 @@ bfree(int dev, uint b)
 // and ip->dev and ip->inum indicate which i-node an entry
 // holds, one must hold itable.lock while using any of those fields.
 //
-// An ip->lock sleep-lock protects all ip-> fields other than ref,
-// dev, and inum.  One must hold ip->lock in order to
-// read or write that inode's ip->valid, ip->size, ip->type, &c.
+// An ip->lock reader-writer sleep-lock protects all ip-> fields
+// other than ref, dev, and inum.  One must hold ip->lock in order to
+// read that inode's ip->valid, ip->size, ip->type, &c., and hold it
+// exclusively to write them.
 
 struct {
   struct spinlock lock;
   struct inode inode[NINODE];
 } itable;
 
+// iget() event counts, kept per CPU like bio.c's, each in
+// a cache line of its own.
+static struct __attribute__((aligned(64))) {
+  uint64 hit;
+  uint64 miss;
+  uint64 recycle;
+} icount[NCPU];
+
+#define ICOUNT(f) do { push_off(); icount[cpuid()].f++; pop_off(); } while(0)
+
 void
 iinit()
 {
@@ -185,7 +200,7 @@ iinit()
   
   initlock(&itable.lock, "itable");
   for(i = 0; i < NINODE; i++) {
-    initsleeplock(&itable.inode[i].lock, "inode");
+    initrwsleeplock(&itable.inode[i].lock, "inode");
   }
 }
 
@@ -255,6 +270,7 @@ iget(uint dev, uint inum)
   for(ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++){
     if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
       ip->ref++;
+      ICOUNT(hit);
       release(&itable.lock);
       return ip;
     }
@@ -267,6 +283,9 @@ iget(uint dev, uint inum)
     panic("iget: no inodes");
 
   ip = empty;
+  ICOUNT(miss);
+  if(ip->valid)
+    ICOUNT(recycle);
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
@@ -276,6 +295,26 @@ iget(uint dev, uint inum)
   return ip;
 }
 
+// Fill in the inode table part of *st.
+void
+icachestat(struct cachestat *st)
+{
+  struct inode *ip;
+  int i;
+
+  st->ninode = NINODE;
+  acquire(&itable.lock);
+  for(ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++)
+    if(ip->ref > 0)
+      st->iused++;
+  release(&itable.lock);
+  for(i = 0; i < NCPU; i++){
+    st->ihit += icount[i].hit;
+    st->imiss += icount[i].miss;
+    st->irecycle += icount[i].recycle;
+  }
+}
+
 // Increment reference count for ip.
 // Returns ip to enable ip = idup(ip1) idiom.
 struct inode*
@@ -298,7 +337,7 @@ ilock(struct inode *ip)
   if(ip == 0 || ip->ref < 1)
     panic("ilock");
 
-  acquiresleep(&ip->lock);
+  acquirewrite(&ip->lock);
 
   if(ip->valid == 0){
     bp = bread(ip->dev, IBLOCK(ip->inum, sb));
@@ -316,14 +355,42 @@ ilock(struct inode *ip)
   }
 }
 
-// Unlock the given inode.
+// Lock the given inode shared, for reading only.
+// Reads the inode from disk if necessary.
+void
+ilockshared(struct inode *ip)
+{
+  if(ip == 0 || ip->ref < 1)
+    panic("ilockshared");
+
+  acquireread(&ip->lock);
+
+  if(ip->valid == 0){
+    // reading it in needs the lock exclusive. once valid,
+    // the inode stays valid while we hold a reference.
+    releaseread(&ip->lock);
+    ilock(ip);
+    iunlock(ip);
+    acquireread(&ip->lock);
+  }
+}
+
+// Unlock the given inode, locked by either ilock()
+// or ilockshared().
 void
 iunlock(struct inode *ip)
 {
-  if(ip == 0 || !holdingsleep(&ip->lock) || ip->ref < 1)
+  if(ip == 0 || ip->ref < 1)
     panic("iunlock");
 
-  releasesleep(&ip->lock);
+  // the writer flag cannot change while we hold the lock.
+  if(ip->lock.writer){
+    if(!holdingwrite(&ip->lock))
+      panic("iunlock");
+    releasewrite(&ip->lock);
+  } else {
+    releaseread(&ip->lock);
+  }
 }
 
 // Drop a reference to an in-memory inode.
@@ -342,8 +409,8 @@ iput(struct inode *ip)
     // inode has no links and no other references: truncate and free.
 
     // ip->ref == 1 means no other process can have ip locked,
-    // so this acquiresleep() won't block (or deadlock).
-    acquiresleep(&ip->lock);
+    // so this acquirewrite() won't block (or deadlock).
+    acquirewrite(&ip->lock);
 
     release(&itable.lock);
 
@@ -352,7 +419,7 @@ iput(struct inode *ip)
     iupdate(ip);
     ip->valid = 0;
 
-    releasesleep(&ip->lock);
+    releasewrite(&ip->lock);
 
     acquire(&itable.lock);
   }
@@ -465,7 +532,8 @@ stati(struct inode *ip, struct stat *st)
 }
 
 // Read data from inode.
-// Caller must hold ip->lock.
+// Caller must hold ip->lock, shared or exclusive. Blocks
+// below ip->size always exist, so bmap() allocates nothing.
 // If user_dst==1, then dst is a user virtual address;
 // otherwise, dst is a kernel address.
 int
@@ -495,6 +563,42 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
   return tot;
 }
 
+// Start reading blocks bn up to end of ip into the buffer
+// cache, without waiting for them, passing runs that are
+// consecutive on disk to breadahead() together. Stops early
+// at the end of the file, if the disk is busy, or if reads
+// ahead hold all the buffers breadroom() allows. Returns the
+// block it stopped at.
+// Caller must hold ip->lock, shared or exclusive.
+uint
+ireadahead(struct inode *ip, uint bn, uint end)
+{
+  uint addr, next, n, m;
+  int room;
+
+  n = (ip->size + BSIZE - 1) / BSIZE;
+  if(end > n)
+    end = n;
+  // next is the mapping of block bn, if already looked up.
+  next = 0;
+  for(; bn < end; bn += m){
+    if((room = breadroom()) == 0)
+      break;
+    addr = next ? next : bmap(ip, bn);
+    if(addr == 0)
+      break;
+    next = 0;
+    for(m = 1; bn + m < end && m < DISKRUN && m < room; m++){
+      if((next = bmap(ip, bn + m)) != addr + m)
+        break;
+      next = 0;
+    }
+    if(!breadahead(ip->dev, addr, m))
+      break;
+  }
+  return bn;
+}
+
 // Write data to inode.
 // Caller must hold ip->lock.
 // If user_src==1, then src is a user virtual address;
@@ -652,14 +756,20 @@ static struct inode*
 namex(char *path, int nameiparent, char *name)
 {
   struct inode *ip, *next;
+  struct proc *p;
 
-  if(*path == '/')
+  if(*path == '/'){
     ip = iget(ROOTDEV, ROOTINO);
-  else
-    ip = idup(myproc()->cwd);
+  } else {
+    // another thread may be changing the shared cwd.
+    p = myproc()->leader;
+    acquire(&p->tglock);
+    ip = idup(p->cwd);
+    release(&p->tglock);
+  }
 
   while((path = skipelem(path, name)) != 0){
-    ilock(ip);
+    ilockshared(ip);
     if(ip->type != T_DIR){
       iunlockput(ip);
       return 0;
@@ -0,0 +1,83 @@
+//
+// Fast user-space locking support.
+// User code does the uncontended work with atomic
+// instructions on an int in its memory, and calls futex()
+// only to sleep until, or to announce, a change to it.
+//
+// A futex is named by the physical address of the int, so
+// that threads and processes sharing the page agree on it.
+// Waiters sleep on that address; it cannot be the channel
+// of any other sleep(), since kernel objects do not live in
+// user pages.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "futex.h"
+#include "defs.h"
+
+#define NBUCKET 31
+
+// bucket[h].lock makes checking the int and going to sleep
+// atomic with respect to wakers of futexes that hash to h.
+struct {
+  struct spinlock lock;
+} bucket[NBUCKET];
+
+void
+futexinit(void)
+{
+  for(int i = 0; i < NBUCKET; i++)
+    initlock(&bucket[i].lock, "futex");
+}
+
+// the address space lock, vmlock(), keeps another thread's
+// sbrk() from freeing the int's page between looking it up
+// and loading it.
+int
+futex(uint64 uaddr, int op, int val)
+{
+  struct proc *p = myproc();
+  struct proc *l = p->leader;
+  uint64 pa;
+  int *f, n;
+  struct spinlock *lk;
+
+  vmlock(l);
+  if(uaddr % sizeof(int) != 0 || uaddr >= l->sz ||
+     (pa = walkaddr(p->pagetable, uaddr)) == 0){
+    vmunlock(l);
+    return -1;
+  }
+  pa += uaddr % PGSIZE;
+  f = (int*)pa;
+  lk = &bucket[(pa / sizeof(int)) % NBUCKET].lock;
+
+  switch(op){
+  case FUTEX_WAIT:
+    acquire(lk);
+    n = __atomic_load_n(f, __ATOMIC_SEQ_CST);
+    vmunlock(l);
+    if(n != val){
+      release(lk);
+      return -1;
+    }
+    sleep(f, lk);
+    release(lk);
+    if(killed(p))
+      return -1;
+    return 0;
+  case FUTEX_WAKE:
+    vmunlock(l);
+    acquire(lk);
+    n = wakeupn(f, val);
+    release(lk);
+    return n;
+  }
+  vmunlock(l);
+  return -1;
+}
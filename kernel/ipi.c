@@ -0,0 +1,52 @@
+//
+// Inter-processor interrupts.
+// ipi_send() sets bits in the target CPU's cpu->ipi and
+// then its CLINT MSIP register. machinevec in kernelvec.S
+// turns the resulting machine-mode software interrupt into
+// a supervisor software interrupt, and devintr() calls
+// ipiintr() to act on the bits.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+// Interrupt CPU cpu, asking it to do what (IPI_* in proc.h).
+void
+ipi_send(int cpu, int what)
+{
+  __sync_fetch_and_or(&cpus[cpu].ipi, what);
+  __sync_synchronize();
+  *(volatile uint32 *)CLINT_MSIP(cpu) = 1;
+}
+
+// Handle an IPI on this CPU.
+// Called from devintr() with interrupts off.
+void
+ipiintr(void)
+{
+  struct cpu *c = mycpu();
+  int what;
+
+  // clear the request first, so that an IPI sent after
+  // the exchange below interrupts again.
+  w_sip(r_sip() & ~SIP_SSIP);
+  what = __atomic_exchange_n(&c->ipi, 0, __ATOMIC_SEQ_CST);
+
+  if(what & IPI_TLB){
+    sfence_vma();
+    c->ntrap++;
+  }
+
+  // have the timer go off right away, so that clockintr()
+  // decides whether to preempt this CPU's process.
+  if(what & IPI_RESCHED)
+    w_stimecmp(r_time());
+
+  // IPI_WAKE needs nothing more: it only ends a wfi
+  // in scheduler(), which then looks for a process.
+}
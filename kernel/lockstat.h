@@ -0,0 +1,16 @@
+// Lock contention statistics, from lockstat().
+// Both the kernel and user programs use this header file.
+//
+// Locks are counted together by name (e.g. all "proc"
+// locks), separately for spinlocks and sleeplocks.
+
+struct lockstat {
+  char name[16];
+  int sleep;           // 1 for sleeplocks, 0 for spinlocks
+  uint64 nacquire;     // times acquired
+  uint64 ncontended;   // times the acquirer had to spin or sleep first
+  uint64 wait;         // microseconds spent spinning or sleeping
+};
+
+// flags for lockstat().
+#define LOCKSTAT_RESET 1   // zero the counts after reading them
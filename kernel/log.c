@@ -64,21 +64,31 @@ initlog(int dev, struct superblock *sb)
   recover_from_log();
 }
 
-// Copy committed blocks from log to their home location
+// Copy committed blocks from log to their home location.
+// All the writes are started before waiting for any, so the
+// disk can work on them together, and write runs of
+// consecutive blocks in one request.
 static void
 install_trans(int recovering)
 {
+  struct buf *dbufs[LOGSIZE];
   int tail;
 
+  // fetch the log in one go, if not cached.
+  breadahead(log.dev, log.start+1, log.lh.n);
   for (tail = 0; tail < log.lh.n; tail++) {
     struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
     struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
     memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    if(recovering == 0)
-      bunpin(dbuf);
     brelse(lbuf);
-    brelse(dbuf);
+    dbufs[tail] = dbuf;
+  }
+  bwritev(dbufs, log.lh.n);  // write dsts to disk
+  for (tail = 0; tail < log.lh.n; tail++) {
+    bwait(dbufs[tail]);
+    if(recovering == 0)
+      bunpin(dbufs[tail]);
+    brelse(dbufs[tail]);
   }
 }
 
@@ -174,19 +184,27 @@ end_op(void)
   }
 }
 
-// Copy modified blocks from cache to log.
+// Copy modified blocks from cache to log, writing them all
+// at once; being consecutive, they go to the disk in one or
+// a few requests. The log blocks stay locked until written,
+// besides the pinned cache blocks, which NBUF leaves room for.
 static void
 write_log(void)
 {
+  struct buf *tos[LOGSIZE];
   int tail;
 
   for (tail = 0; tail < log.lh.n; tail++) {
     struct buf *to = bread(log.dev, log.start+tail+1); // log block
     struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
     memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
     brelse(from);
-    brelse(to);
+    tos[tail] = to;
+  }
+  bwritev(tos, log.lh.n);  // write the log
+  for (tail = 0; tail < log.lh.n; tail++) {
+    bwait(tos[tail]);
+    brelse(tos[tail]);
   }
 }
 
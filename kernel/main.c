@@ -20,8 +20,11 @@ main()
     kvminit();       // create kernel page table
     kvminithart();   // turn on paging
     procinit();      // process table
+    futexinit();     // user-space lock support
     trapinit();      // trap vectors
     trapinithart();  // install kernel trap vector
+    fpuinit();       // floating-point and vector units
+    fpuinithart();   // turn them off until first use
     plicinit();      // set up interrupt controller
     plicinithart();  // ask PLIC for device interrupts
     binit();         // buffer cache
@@ -38,6 +41,7 @@ main()
     printf("hart %d starting\n", cpuid());
     kvminithart();    // turn on paging
     trapinithart();   // install kernel trap vector
+    fpuinithart();    // turn off floating-point and vector units
     plicinithart();   // ask PLIC for device interrupts
   }
 
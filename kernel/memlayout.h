@@ -17,6 +17,14 @@
 // end -- start of kernel page allocation area
 // PHYSTOP -- end RAM used by the kernel
 
+// rate at which qemu's time CSR (r_time()) counts, in Hz.
+#define TIMEFREQ 10000000L
+
+// core local interruptor (CLINT). setting a hart's MSIP
+// register sends it a machine-mode software interrupt.
+#define CLINT 0x2000000L
+#define CLINT_MSIP(hartid) (CLINT + 4*(hartid))
+
 // qemu puts UART registers here in physical memory.
 #define UART0 0x10000000L
 #define UART0_IRQ 10
@@ -54,6 +62,11 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
+//   THREADFRAME(NTHREAD-1) .. THREADFRAME(1) (other threads'
+//     trapframes, each with its shared page just below)
+//   USHARED (p->ushared, read-only in user mode; ushared.h)
 //   TRAPFRAME (p->trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+#define THREADFRAME(i) (TRAPFRAME - 2*(i)*PGSIZE)
+#define USHARED (TRAPFRAME - PGSIZE)
@@ -1,6 +1,7 @@
-#define NPROC        64  // maximum number of processes
+#define NPROC      4096  // maximum number of processes
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
+#define NTHREAD      16  // threads per process, including the first
 #define NFILE       100  // open files per system
 #define NINODE       50  // maximum number of active i-nodes
 #define NDEV         10  // maximum major device number
@@ -8,6 +9,23 @@
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       2000  // size of file system in blocks
+#define NBUF         (LOGSIZE*2+MAXOPBLOCKS)  // least size of disk block cache
+#define FSSIZE       10000 // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
+#define NLATBUCKET   32    // scheduling latency histogram buckets (sched.h)
+#define NLOCKCLASS   64    // lock classes counted by lockstat()
+#define SLEEPSPIN    20    // microseconds to spin for a running sleeplock holder
+#define READAHEAD    32    // most blocks to read ahead of a sequential reader
+#define DISKRUN      32    // most blocks in one disk request
+#ifndef SCHEDULER
+#define SCHEDULER    SCHED_RR  // policy for SCHED_NORMAL processes (sched.h)
+#endif
+#ifndef BCACHEPOLICY
+#define BCACHEPOLICY BCACHE_2Q // buffer cache replacement (buf.h)
+#endif
+#ifndef SPINLOCK
+#define SPINLOCK     SPIN_TAS  // spinlock implementation (spinlock.h)
+#endif
+#ifndef VIRTIORING
+#define VIRTIORING   VIRTIO_RING_FAST  // virtio ring features for the disk (virtio.h)
+#endif
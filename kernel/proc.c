@@ -4,58 +4,221 @@
 #include "riscv.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "sched.h"
+#include "rusage.h"
+#include "ushared.h"
 #include "defs.h"
 
 struct cpu cpus[NCPU];
 
-struct proc proc[NPROC];
+// struct procs are allocated a page's worth at a time, as
+// needed, up to NPROC, and never freed. allproc links them
+// all, newest first; the list only grows, so it can be
+// walked without a lock.
+struct proc *allproc;
+int nproc;
+
+// incremented by growprocs() each time it maps a new kernel
+// stack; a CPU whose cpu->kstackgen is older may hold stale
+// TLB entries for the stack, and must flush before using it.
+uint64 kstackgen;
 
 struct proc *initproc;
 
+// pid_lock protects nextpid, the pid hash table, the free
+// list of UNUSED procs, and adding to allproc.
+// may be acquired while holding a p->lock.
 int nextpid = 1;
 struct spinlock pid_lock;
+#define NPIDHASH 256
+struct proc *pidhash[NPIDHASH];
+struct proc *freeprocs;
+
+// SLEEPING processes, hashed by channel, so that wakeup()
+// looks only at those that may be sleeping on its channel.
+// a sleepq lock comes after the lock passed to sleep() and
+// before any p->lock.
+#define NSLEEPQ 127
+struct sleepq {
+  struct spinlock lock;
+  struct proc *head;   // through p->sqnext
+} sleepq[NSLEEPQ];
+
+extern pagetable_t kernel_pagetable; // vm.c
 
 extern void forkret(void);
 static void freeproc(struct proc *p);
+static void runproc(struct cpu *c, struct proc *p);
+static void setrunnable(struct proc *p);
+static struct proc *pickproc(struct cpu *c);
+static void sibinsert(struct proc **head, struct proc *p);
+static void kickidle(struct proc *p);
+static void addusage(struct usage *a, struct usage *b);
+static int affine(struct cpu *c, struct proc *p, uint64 now);
+static void enqueue(struct proc *p);
+static int dequeue(struct proc *p);
+static int rq_remove(struct proc **pp, struct proc *p);
+static void rr_enqueue(struct proc *p);
+static struct proc *rr_dequeue(struct cpu *c);
+static void cfs_enqueue(struct proc *p);
+static struct proc *cfs_dequeue(struct cpu *c);
+static void dl_enqueue(struct proc *p);
+static struct proc *dl_dequeue(struct cpu *c);
+static void dl_switchin(struct cpu *c, struct proc *p);
+static void dl_account(struct proc *p, uint64 delta);
+static int dl_admit(struct proc *p, uint64 runtime, uint64 deadline, uint64 period);
+static void dl_leave(struct proc *p);
+static int effweight(struct proc *p);
+static void boost_enqueue(struct proc *p);
+static struct proc *boost_dequeue(struct cpu *c);
 
 extern char trampoline[]; // trampoline.S
 
-// helps ensure that wakeups of wait()ing
-// parents are not lost. helps obey the
-// memory model when using p->parent.
+// helps ensure that wakeups of join()ing
+// threads are not lost. helps obey the
+// memory model when using p->leader.
 // must be acquired before any p->lock.
+// wait() instead uses the parent's p->childlock.
 struct spinlock wait_lock;
 
-// Allocate a page for each process's kernel stack.
-// Map it high in memory, followed by an invalid
-// guard page.
-void
-proc_mapstacks(pagetable_t kpgtbl)
-{
-  struct proc *p;
-  
-  for(p = proc; p < &proc[NPROC]; p++) {
-    char *pa = kalloc();
-    if(pa == 0)
-      panic("kalloc");
-    uint64 va = KSTACK((int) (p - proc));
-    kvmmap(kpgtbl, va, (uint64)pa, PGSIZE, PTE_R | PTE_W);
-  }
-}
+// how the scheduler picks among SCHED_NORMAL processes.
+int schedpolicy = SCHEDULER;
+
+// CPUs that have entered scheduler().
+int ncpu;
+
+// may p run on CPU c?
+#define CANRUN(c, p) (((p)->affinity >> ((c) - cpus)) & 1)
+
+// a process that has been RUNNABLE this long is assumed to
+// have lost its cache and TLB state, so any CPU may as well
+// take it from the CPU it last ran on.
+#define MIGRATE_DELAY 1000000  // about a tick, in r_time() units
+
+// SCHED_RR run queue of RUNNABLE processes that are not
+// running on any CPU, in the order they became RUNNABLE.
+// rr.lock may be acquired while holding a p->lock.
+struct {
+  struct spinlock lock;
+  struct proc *head;
+} rr;
+
+// SCHED_CFS run queue of RUNNABLE processes that are not
+// running on any CPU, sorted by vruntime, smallest first.
+// cfs.lock may be acquired while holding a p->lock.
+struct {
+  struct spinlock lock;
+  struct proc *head;
+  uint64 minvruntime; // vruntime of the latest process picked
+} cfs;
+
+// how far behind the rest of the run queue a process that
+// wakes up may be placed. a little credit favors interactive
+// processes; more would let a long sleeper hog the CPU.
+#define CFS_WAKEUP_CREDIT 1000000  // about a tick, in r_time() units
+
+// SCHED_DEADLINE run queues of RUNNABLE processes that are
+// not running on any CPU, and the bandwidth reserved by all
+// deadline processes. dl.lock may be acquired while holding
+// a p->lock.
+struct {
+  struct spinlock lock;
+  struct proc *ready;     // sorted by dl_absdeadline, earliest first
+  struct proc *throttled; // out of budget, sorted by dl_nextperiod
+  struct proc *boosted;   // SCHED_NORMAL with p->dlboost, first come first
+  uint64 bw;              // sum of dl_bw
+} dl;
+
+// bandwidth is runtime/period in fixed point; a whole CPU
+// is 1<<DL_BWSHIFT. admission control leaves each CPU a
+// little time for SCHED_NORMAL processes.
+#define DL_BWSHIFT 20
+#define DL_BWMAX   ((95 << DL_BWSHIFT) / 100)
+#define DL_PERIOD_MAX 10000000   // 10 seconds, in microseconds
 
 // initialize the proc table.
 void
 procinit(void)
 {
-  struct proc *p;
-  
   initlock(&pid_lock, "nextpid");
   initlock(&wait_lock, "wait_lock");
-  for(p = proc; p < &proc[NPROC]; p++) {
-      initlock(&p->lock, "proc");
-      p->state = UNUSED;
-      p->kstack = KSTACK((int) (p - proc));
+  initlock(&rr.lock, "rr");
+  initlock(&cfs.lock, "cfs");
+  initlock(&dl.lock, "dl");
+  for(int i = 0; i < NSLEEPQ; i++)
+    initlock(&sleepq[i].lock, "sleepq");
+}
+
+// Add a page's worth of UNUSED procs to the free list. Give
+// each a kernel stack, mapped high in memory, followed by an
+// invalid guard page.
+// Caller must hold pid_lock.
+static void
+growprocs(void)
+{
+  struct proc *p, *procs;
+  char *pa;
+  int i;
+
+  if(nproc >= NPROC || (procs = (struct proc*)kalloc()) == 0)
+    return;
+  memset(procs, 0, PGSIZE);
+
+  for(i = 0; i < PGSIZE / sizeof(struct proc) && nproc < NPROC; i++){
+    p = &procs[i];
+    if((pa = kalloc()) == 0)
+      break;
+    if(mappages(kernel_pagetable, KSTACK(nproc), PGSIZE,
+                (uint64)pa, PTE_R | PTE_W) < 0){
+      kfree(pa);
+      break;
+    }
+    initlock(&p->lock, "proc");
+    initlock(&p->tglock, "tg");
+    initlock(&p->childlock, "child");
+    p->state = UNUSED;
+    p->kstack = KSTACK(nproc);
+    kstackgen++;
+    p->next = freeprocs;
+    freeprocs = p;
+
+    // make p visible to scanners of allproc
+    // only once it is initialized.
+    p->allnext = allproc;
+    __sync_synchronize();
+    allproc = p;
+    nproc++;
   }
+  sfence_vma();
+
+  if(i == 0)
+    kfree(procs);
+}
+
+// Return the process with the given pid, with p->lock
+// held, or 0 if there is none (or pid is not positive).
+static struct proc*
+pidlookup(int pid)
+{
+  struct proc *p;
+
+  if(pid <= 0)
+    return 0;
+  acquire(&pid_lock);
+  for(p = pidhash[pid % NPIDHASH]; p; p = p->next)
+    if(p->pid == pid)
+      break;
+  release(&pid_lock);
+
+  if(p == 0)
+    return 0;
+  // p may have exited since; procs are never freed,
+  // so it is safe to look.
+  acquire(&p->lock);
+  if(p->pid == pid && p->state != UNUSED)
+    return p;
+  release(&p->lock);
+  return 0;
 }
 
 // Must be called with interrupts disabled,
@@ -89,20 +252,26 @@ myproc(void)
   return p;
 }
 
+// Give p a new pid, and enter it in the pid hash table.
+// Caller must hold p->lock.
 int
-allocpid()
+allocpid(struct proc *p)
 {
   int pid;
   
   acquire(&pid_lock);
   pid = nextpid;
   nextpid = nextpid + 1;
+  p->pid = pid;
+  p->next = pidhash[pid % NPIDHASH];
+  pidhash[pid % NPIDHASH] = p;
   release(&pid_lock);
 
   return pid;
 }
 
-// Look in the process table for an UNUSED proc.
+// Take an UNUSED proc from the free list, making more
+// if there are none.
 // If found, initialize state required to run in the kernel,
 // and return with p->lock held.
 // If there are no free procs, or a memory allocation fails, return 0.
@@ -111,19 +280,35 @@ allocproc(void)
 {
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    acquire(&p->lock);
-    if(p->state == UNUSED) {
-      goto found;
-    } else {
-      release(&p->lock);
-    }
-  }
-  return 0;
+  acquire(&pid_lock);
+  if(freeprocs == 0)
+    growprocs();
+  if((p = freeprocs) != 0)
+    freeprocs = p->next;
+  release(&pid_lock);
+  if(p == 0)
+    return 0;
+
+  // freeproc() may not have released p->lock yet.
+  acquire(&p->lock);
+  if(p->state != UNUSED)
+    panic("allocproc");
 
-found:
-  p->pid = allocpid();
+  allocpid(p);
   p->state = USED;
+  p->leader = p;
+  p->tslots = 1;
+  p->tfva = TRAPFRAME;
+  p->policy = SCHED_NORMAL;
+  p->weight = WEIGHT_DEFAULT;
+  p->boost = 0;
+  p->dlboost = 0;
+  p->vruntime = 0;
+  p->affinity = ~0L;
+  p->lastcpu = -1;
+  p->migrations = 0;
+  p->fpcpu = -1;
+  p->vcpu = -1;
 
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
@@ -132,6 +317,18 @@ found:
     return 0;
   }
 
+  // And the page it shares with user code.
+  if((p->ushared = (struct ushared *)kalloc()) == 0){
+    freeproc(p);
+    release(&p->lock);
+    return 0;
+  }
+  memset(p->ushared, 0, PGSIZE);
+  p->ushared->pid = p->pid;
+  p->ushared->tid = p->pid;
+  p->ushared->timefreq = TIMEFREQ;
+  p->ushared->boottime = boottime;
+
   // An empty user page table.
   p->pagetable = proc_pagetable(p);
   if(p->pagetable == 0){
@@ -150,25 +347,60 @@ found:
 }
 
 // free a proc structure and the data hanging from it,
-// including user pages.
-// p->lock must be held.
+// including user pages, unless it is a thread sharing
+// them with its leader; exit() has already taken such a
+// thread's trapframe and shared page out of the leader's
+// page table.
+// p->lock must be held, and wait_lock too for a thread.
 static void
 freeproc(struct proc *p)
 {
+  struct proc **pp;
+
   if(p->trapframe)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
-  if(p->pagetable)
+  if(p->ushared)
+    kfree((void*)p->ushared);
+  p->ushared = 0;
+  if(p->pagetable && p->leader && p->leader != p){
+    p->leader->tslots &= ~(1 << (TRAPFRAME - p->tfva) / (2*PGSIZE));
+  } else if(p->pagetable){
     proc_freepagetable(p->pagetable, p->sz);
+  }
   p->pagetable = 0;
   p->sz = 0;
-  p->pid = 0;
+  p->tfva = 0;
   p->parent = 0;
+  p->leader = 0;
+  p->tslots = 0;
   p->name[0] = 0;
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
+  if(p->policy == SCHED_DEADLINE)
+    dl_leave(p);
+  p->weight = 0;
+  p->boost = 0;
+  p->dlboost = 0;
+  p->nsleeplocks = 0;
+  memset(&p->u, 0, sizeof(p->u));
+  memset(&p->tu, 0, sizeof(p->tu));
+  memset(&p->cu, 0, sizeof(p->cu));
   p->state = UNUSED;
+
+  // take p out of the pid hash table, and make it
+  // available to allocproc().
+  acquire(&pid_lock);
+  if(p->pid){
+    for(pp = &pidhash[p->pid % NPIDHASH]; *pp != p; pp = &(*pp)->next)
+      ;
+    *pp = p->next;
+  }
+  p->pid = 0;
+  p->next = freeprocs;
+  freeprocs = p;
+  release(&pid_lock);
 }
 
 // Create a user page table for a given process, with no user memory,
@@ -202,6 +434,15 @@ proc_pagetable(struct proc *p)
     return 0;
   }
 
+  // and the shared page below that, which user code may read.
+  if(mappages(pagetable, USHARED, PGSIZE,
+              (uint64)(p->ushared), PTE_R | PTE_U) < 0){
+    uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+    uvmunmap(pagetable, TRAPFRAME, 1, 0);
+    uvmfree(pagetable, 0);
+    return 0;
+  }
+
   return pagetable;
 }
 
@@ -212,6 +453,7 @@ proc_freepagetable(pagetable_t pagetable, uint64 sz)
 {
   uvmunmap(pagetable, TRAMPOLINE, 1, 0);
   uvmunmap(pagetable, TRAPFRAME, 1, 0);
+  uvmunmap(pagetable, USHARED, 1, 0);
   uvmfree(pagetable, sz);
 }
 
@@ -249,29 +491,95 @@ userinit(void)
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
 
-  p->state = RUNNABLE;
+  setrunnable(p);
 
   release(&p->lock);
 }
 
+// Keep other threads of leader l from changing the size
+// of the address space or its page table until vmunlock().
+void
+vmlock(struct proc *l)
+{
+  acquire(&l->tglock);
+  while(l->vmbusy)
+    sleep(&l->vmbusy, &l->tglock);
+  l->vmbusy = 1;
+  release(&l->tglock);
+}
+
+void
+vmunlock(struct proc *l)
+{
+  acquire(&l->tglock);
+  l->vmbusy = 0;
+  wakeup(&l->vmbusy);
+  release(&l->tglock);
+}
+
 // Grow or shrink user memory by n bytes.
-// Return 0 on success, -1 on failure.
-int
+// Return the old size, or -1 on failure.
+uint64
 growproc(int n)
 {
-  uint64 sz;
-  struct proc *p = myproc();
+  uint64 a, oldsz, sz;
+  struct proc *l = myproc()->leader;
 
-  sz = p->sz;
+  vmlock(l);
+  oldsz = sz = l->sz;
   if(n > 0){
-    if((sz = uvmalloc(p->pagetable, sz, sz + n, PTE_W)) == 0) {
+    if((sz = uvmalloc(l->pagetable, sz, sz + n, PTE_W)) == 0) {
+      vmunlock(l);
       return -1;
     }
-  } else if(n < 0){
-    sz = uvmdealloc(p->pagetable, sz, sz + n);
+  } else if(n < 0 && sz + n < sz){
+    // other threads may have the pages in their TLBs; take
+    // them away from user space and wait until no CPU can
+    // still reach them before freeing them.
+    for(a = PGROUNDUP(sz + n); a < PGROUNDUP(sz); a += PGSIZE)
+      uvmclear(l->pagetable, a);
+    tlbshootdown(l->pagetable);
+    sz = uvmdealloc(l->pagetable, sz, sz + n);
   }
-  p->sz = sz;
-  return 0;
+  l->sz = sz;
+  vmunlock(l);
+  return oldsz;
+}
+
+// Wait until no other CPU can be using TLB entries for
+// pagetable cached before the caller changed it. Each CPU
+// flushes its TLB on every trap from user space and every
+// return to it (see trampoline.S), and on an IPI_TLB, so
+// send one to each CPU that is running a thread with this
+// page table and wait for it to count a flush in c->ntrap.
+// A CPU that switches to such a thread meanwhile gets no
+// IPI, but counts the flush on its way to user space.
+// The caller must not hold any spinlocks, since the
+// other CPUs may need them before they take the IPI.
+void
+tlbshootdown(pagetable_t pagetable)
+{
+  uint64 ntrap[NCPU];
+  struct cpu *c;
+  struct proc *p;
+  int busy;
+
+  for(c = cpus; c < &cpus[NCPU]; c++){
+    ntrap[c - cpus] = c->ntrap;
+    p = c->proc;
+    if(p && p != myproc() && p->pagetable == pagetable)
+      ipi_send(c - cpus, IPI_TLB);
+  }
+
+  do {
+    busy = 0;
+    for(c = cpus; c < &cpus[NCPU]; c++){
+      p = c->proc;
+      if(p && p != myproc() && p->pagetable == pagetable &&
+         c->ntrap == ntrap[c - cpus])
+        busy = 1;
+    }
+  } while(busy);
 }
 
 // Create a new process, copying the parent.
@@ -282,103 +590,401 @@ fork(void)
   int i, pid;
   struct proc *np;
   struct proc *p = myproc();
+  struct proc *l = p->leader;
+
+  // keep other threads from changing memory during the copy.
+  vmlock(l);
 
   // Allocate process.
   if((np = allocproc()) == 0){
+    vmunlock(l);
     return -1;
   }
 
   // Copy user memory from parent to child.
-  if(uvmcopy(p->pagetable, np->pagetable, p->sz) < 0){
+  // the child gets only the calling thread.
+  if(uvmcopy(l->pagetable, np->pagetable, l->sz) < 0){
     freeproc(np);
     release(&np->lock);
+    vmunlock(l);
     return -1;
   }
-  np->sz = p->sz;
+  np->sz = l->sz;
 
   // copy saved user registers.
+  fpusync(p);
   *(np->trapframe) = *(p->trapframe);
 
   // Cause fork to return 0 in the child.
   np->trapframe->a0 = 0;
 
+  // the caller may be a thread, with its own shared page.
+  np->trapframe->tp = USHARED;
+
+  safestrcpy(np->name, p->name, sizeof(p->name));
+
+  np->weight = p->weight;
+  np->vruntime = p->vruntime;
+  np->affinity = p->affinity;
+
+  pid = np->pid;
+
+  release(&np->lock);
+  vmunlock(l);
+
   // increment reference counts on open file descriptors.
+  // l->tglock comes before any p->lock.
+  acquire(&l->tglock);
   for(i = 0; i < NOFILE; i++)
-    if(p->ofile[i])
-      np->ofile[i] = filedup(p->ofile[i]);
-  np->cwd = idup(p->cwd);
+    if(l->ofile[i])
+      np->ofile[i] = filedup(l->ofile[i]);
+  np->cwd = idup(l->cwd);
+  release(&l->tglock);
+
+  acquire(&p->childlock);
+  np->parent = p;
+  sibinsert(&p->children, np);
+  release(&p->childlock);
+
+  acquire(&np->lock);
+  setrunnable(np);
+  release(&np->lock);
+
+  return pid;
+}
+
+// Create a new thread in the calling process, sharing its
+// memory, open files, and current directory. The thread
+// starts in fn(arg) with its stack pointer at stack, and
+// must call exit() rather than return from fn.
+// Returns the new thread's pid, or -1.
+int
+clone(uint64 fn, uint64 arg, uint64 stack)
+{
+  int i, tid;
+  struct proc *np;
+  struct proc *p = myproc();
+  struct proc *l = p->leader;
+
+  // keep other threads from changing the page table
+  // while the new thread's trapframe goes into it.
+  vmlock(l);
+
+  if((np = allocproc()) == 0){
+    vmunlock(l);
+    return -1;
+  }
+
+  // share the leader's page table instead of a new one.
+  proc_freepagetable(np->pagetable, 0);
+  np->pagetable = l->pagetable;
+
+  // start in fn(arg), with the caller's other registers.
+  fpusync(p);
+  *(np->trapframe) = *(p->trapframe);
+  np->trapframe->epc = fn;
+  np->trapframe->sp = stack;
+  np->trapframe->a0 = arg;
+  np->trapframe->ra = 0;
 
   safestrcpy(np->name, p->name, sizeof(p->name));
 
-  pid = np->pid;
+  np->weight = p->weight;
+  np->vruntime = p->vruntime;
+  np->affinity = p->affinity;
+
+  tid = np->pid;
 
   release(&np->lock);
 
   acquire(&wait_lock);
-  np->parent = p;
+  for(i = 1; i < NTHREAD; i++)
+    if((l->tslots & (1 << i)) == 0)
+      break;
+  // a killed caller may be racing with killthreads().
+  if(i == NTHREAD || killed(p))
+    goto bad;
+  if(mappages(l->pagetable, THREADFRAME(i), PGSIZE,
+              (uint64)(np->trapframe), PTE_R | PTE_W) < 0)
+    goto bad;
+  if(mappages(l->pagetable, THREADFRAME(i) - PGSIZE, PGSIZE,
+              (uint64)(np->ushared), PTE_R | PTE_U) < 0){
+    uvmunmap(l->pagetable, THREADFRAME(i), 1, 0);
+    goto bad;
+  }
+  l->tslots |= 1 << i;
+  np->tfva = THREADFRAME(i);
+  np->leader = l;
+  np->trapframe->tp = THREADFRAME(i) - PGSIZE;
+  np->ushared->pid = l->pid;
   release(&wait_lock);
+  vmunlock(l);
 
   acquire(&np->lock);
-  np->state = RUNNABLE;
+  setrunnable(np);
   release(&np->lock);
 
-  return pid;
+  return tid;
+
+ bad:
+  release(&wait_lock);
+  vmunlock(l);
+  acquire(&np->lock);
+  np->pagetable = 0;
+  freeproc(np);
+  release(&np->lock);
+  return -1;
+}
+
+// Wait for thread tid of the calling process, or for any
+// of its threads if tid is 0, to exit. Copies the thread's
+// exit status to addr and returns its pid.
+// Return -1 if there is no such thread.
+int
+join(int tid, uint64 addr)
+{
+  struct proc *pp;
+  int havethreads, pid;
+  struct proc *p = myproc();
+  struct proc *l = p->leader;
+
+  acquire(&wait_lock);
+
+  for(;;){
+    // Scan through table looking for exited threads.
+    havethreads = 0;
+    for(pp = allproc; pp; pp = pp->allnext){
+      if(pp->leader != l || pp == l || pp == p)
+        continue;
+      if(tid != 0 && pp->pid != tid)
+        continue;
+      // make sure the thread isn't still in exit() or swtch().
+      acquire(&pp->lock);
+
+      havethreads = 1;
+      if(pp->state == ZOMBIE){
+        pid = pp->pid;
+        if(addr != 0 && copyout(p->pagetable, addr, (char *)&pp->xstate,
+                                sizeof(pp->xstate)) < 0) {
+          release(&pp->lock);
+          release(&wait_lock);
+          return -1;
+        }
+        addusage(&l->tu, &pp->u);
+        freeproc(pp);
+        release(&pp->lock);
+        release(&wait_lock);
+        return pid;
+      }
+      release(&pp->lock);
+    }
+
+    if(!havethreads || killed(p)){
+      release(&wait_lock);
+      return -1;
+    }
+
+    // threads wake their leader when they exit.
+    sleep(l, &wait_lock);
+  }
 }
 
-// Pass p's abandoned children to init.
-// Caller must hold wait_lock.
+// Kill the other threads of leader p, and wait for them
+// to exit, so that p has its memory and files to itself.
 void
-reparent(struct proc *p)
+killthreads(struct proc *p)
 {
   struct proc *pp;
+  int n;
+
+  acquire(&wait_lock);
 
-  for(pp = proc; pp < &proc[NPROC]; pp++){
-    if(pp->parent == p){
-      pp->parent = initproc;
-      wakeup(initproc);
+  for(;;){
+    n = 0;
+    for(pp = allproc; pp; pp = pp->allnext){
+      if(pp->leader != p || pp == p)
+        continue;
+      acquire(&pp->lock);
+      if(pp->state == ZOMBIE){
+        addusage(&p->tu, &pp->u);
+        freeproc(pp);
+      } else {
+        pp->killed = 1;
+        if(pp->state == SLEEPING)
+          setrunnable(pp);
+        n++;
+      }
+      release(&pp->lock);
     }
+    if(n == 0)
+      break;
+    sleep(p, &wait_lock);
+  }
+
+  release(&wait_lock);
+}
+
+// Add p to the front of the sibling list *head.
+// Caller must hold the parent's childlock.
+static void
+sibinsert(struct proc **head, struct proc *p)
+{
+  p->sibnext = *head;
+  if(*head)
+    (*head)->sibprev = &p->sibnext;
+  p->sibprev = head;
+  *head = p;
+}
+
+// Remove p from its parent's children or zombies list.
+// Caller must hold the parent's childlock.
+static void
+sibremove(struct proc *p)
+{
+  *p->sibprev = p->sibnext;
+  if(p->sibnext)
+    p->sibnext->sibprev = p->sibprev;
+  p->sibnext = 0;
+  p->sibprev = 0;
+}
+
+// Wake p if it is sleeping on chan.
+// Caller must not hold p->lock.
+static void
+wakeproc(struct proc *p, void *chan)
+{
+  acquire(&p->lock);
+  if(p->state == SLEEPING && p->chan == chan)
+    setrunnable(p);
+  release(&p->lock);
+}
+
+// Acquire the childlock of p's parent, and return the parent.
+// The parent may hand p to init meanwhile, so check that it
+// is still p's parent once locked; procs are never freed, so
+// locking a stale parent is harmless.
+static struct proc*
+lockparent(struct proc *p)
+{
+  struct proc *pp;
+
+  for(;;){
+    pp = p->parent;
+    acquire(&pp->childlock);
+    if(p->parent == pp)
+      return pp;
+    release(&pp->childlock);
+  }
+}
+
+// Pass p's abandoned children to its leader, if p is a
+// thread, so that they stay with the process; else to init.
+// The leader outlives its threads, since its exit() waits
+// for them in killthreads().
+// A thread's childlock may be held while acquiring its
+// leader's, and any childlock while acquiring initproc's.
+static void
+reparent(struct proc *p)
+{
+  struct proc *pp, *heir;
+  int zombies;
+
+  heir = p->leader != p ? p->leader : initproc;
+  acquire(&p->childlock);
+  if(p->children == 0 && p->zombies == 0){
+    release(&p->childlock);
+    return;
+  }
+  acquire(&heir->childlock);
+  while((pp = p->children) != 0){
+    sibremove(pp);
+    pp->parent = heir;
+    sibinsert(&heir->children, pp);
   }
+  zombies = p->zombies != 0;
+  while((pp = p->zombies) != 0){
+    sibremove(pp);
+    pp->parent = heir;
+    sibinsert(&heir->zombies, pp);
+  }
+  if(zombies)
+    wakeproc(heir, heir);
+  release(&heir->childlock);
+  release(&p->childlock);
 }
 
 // Exit the current process.  Does not return.
 // An exited process remains in the zombie state
 // until its parent calls wait().
+// A thread other than the leader exits alone, and remains
+// a zombie until join(); the leader's exit ends them all.
 void
 exit(int status)
 {
   struct proc *p = myproc();
+  struct proc *pp;
 
   if(p == initproc)
     panic("init exiting");
 
-  // Close all open files.
-  for(int fd = 0; fd < NOFILE; fd++){
-    if(p->ofile[fd]){
-      struct file *f = p->ofile[fd];
-      fileclose(f);
-      p->ofile[fd] = 0;
+  if(p->leader == p){
+    killthreads(p);
+
+    // Close all open files.
+    for(int fd = 0; fd < NOFILE; fd++){
+      if(p->ofile[fd]){
+        struct file *f = p->ofile[fd];
+        fileclose(f);
+        p->ofile[fd] = 0;
+      }
     }
+
+    begin_op();
+    iput(p->cwd);
+    end_op();
+    p->cwd = 0;
+  } else {
+    // the other threads' CPUs may have this thread's shared
+    // page, which user code can read, in their TLBs. unmap
+    // it and the trapframe, and wait until no CPU can reach
+    // them, before freeproc() frees them.
+    vmlock(p->leader);
+    uvmunmap(p->pagetable, p->tfva - PGSIZE, 2, 0);
+    vmunlock(p->leader);
+    tlbshootdown(p->pagetable);
   }
 
-  begin_op();
-  iput(p->cwd);
-  end_op();
-  p->cwd = 0;
+  // Give any children to the leader or to init.
+  reparent(p);
 
-  acquire(&wait_lock);
+  if(p->leader == p){
+    pp = lockparent(p);
 
-  // Give any children to init.
-  reparent(p);
+    // Parent might be sleeping in wait().
+    wakeproc(pp, pp);
 
-  // Parent might be sleeping in wait().
-  wakeup(p->parent);
-  
-  acquire(&p->lock);
+    acquire(&p->lock);
 
-  p->xstate = status;
-  p->state = ZOMBIE;
+    p->xstate = status;
+    p->state = ZOMBIE;
+    sibremove(p);
+    sibinsert(&pp->zombies, p);
 
-  release(&wait_lock);
+    release(&pp->childlock);
+  } else {
+    acquire(&wait_lock);
+
+    // Other threads might be sleeping in
+    // join() or killthreads().
+    wakeup(p->leader);
+
+    acquire(&p->lock);
+
+    p->xstate = status;
+    p->state = ZOMBIE;
+
+    release(&wait_lock);
+  }
 
   // Jump into the scheduler, never to return.
   sched();
@@ -389,51 +995,140 @@ exit(int status)
 // Return -1 if this process has no children.
 int
 wait(uint64 addr)
+{
+  return wait4(-1, addr, 0, 0);
+}
+
+// Return the first of the children on list that has the given pid,
+// or the first of them if pid is -1.
+static struct proc*
+findchild(struct proc *list, int pid)
+{
+  struct proc *pp;
+
+  for(pp = list; pp; pp = pp->sibnext)
+    if(pid == -1 || pp->pid == pid)
+      return pp;
+  return 0;
+}
+
+// Add the resources counted in b to a.
+static void
+addusage(struct usage *a, struct usage *b)
+{
+  a->utime += b->utime;
+  a->stime += b->stime;
+  a->nvcsw += b->nvcsw;
+  a->nivcsw += b->nivcsw;
+  a->nfault += b->nfault;
+}
+
+// Convert u to the form getrusage() reports.
+static void
+tousage(struct usage *u, struct rusage *ru)
+{
+  ru->utime = u->utime / (TIMEFREQ / 1000000);
+  ru->stime = u->stime / (TIMEFREQ / 1000000);
+  ru->nvcsw = u->nvcsw;
+  ru->nivcsw = u->nivcsw;
+  ru->nfault = u->nfault;
+}
+
+// Wait for child process pid, or any child if pid is -1, to exit.
+// Copy its exit status to addr and the resources it used,
+// including by its threads and waited-for children, to ruaddr.
+// Return the child's pid; 0 if options has WNOHANG and no
+// such child has exited yet; or -1 if there is no such child.
+int
+wait4(int pid, uint64 addr, int options, uint64 ruaddr)
 {
   struct proc *pp;
-  int havekids, pid;
   struct proc *p = myproc();
+  struct usage u;
+  struct rusage ru;
 
-  acquire(&wait_lock);
+  acquire(&p->childlock);
 
   for(;;){
-    // Scan through table looking for exited children.
-    havekids = 0;
-    for(pp = proc; pp < &proc[NPROC]; pp++){
-      if(pp->parent == p){
-        // make sure the child isn't still in exit() or swtch().
-        acquire(&pp->lock);
-
-        havekids = 1;
-        if(pp->state == ZOMBIE){
-          // Found one.
-          pid = pp->pid;
-          if(addr != 0 && copyout(p->pagetable, addr, (char *)&pp->xstate,
-                                  sizeof(pp->xstate)) < 0) {
-            release(&pp->lock);
-            release(&wait_lock);
-            return -1;
-          }
-          freeproc(pp);
-          release(&pp->lock);
-          release(&wait_lock);
-          return pid;
-        }
+    if((pp = findchild(p->zombies, pid)) != 0){
+      // make sure the child isn't still in exit() or swtch().
+      acquire(&pp->lock);
+
+      // the child and its threads are done, so nothing
+      // else changes these now.
+      u = pp->u;
+      addusage(&u, &pp->tu);
+      addusage(&u, &pp->cu);
+      tousage(&u, &ru);
+
+      pid = pp->pid;
+      if((addr != 0 && copyout(p->pagetable, addr, (char *)&pp->xstate,
+                               sizeof(pp->xstate)) < 0) ||
+         (ruaddr != 0 && copyout(p->pagetable, ruaddr, (char *)&ru,
+                                 sizeof(ru)) < 0)) {
         release(&pp->lock);
+        release(&p->childlock);
+        return -1;
       }
+      sibremove(pp);
+      freeproc(pp);
+      release(&pp->lock);
+      release(&p->childlock);
+
+      acquire(&p->leader->tglock);
+      addusage(&p->leader->cu, &u);
+      release(&p->leader->tglock);
+      return pid;
     }
 
-    // No point waiting if we don't have any children.
-    if(!havekids || killed(p)){
-      release(&wait_lock);
+    // No point waiting if we don't have any such children.
+    if(findchild(p->children, pid) == 0 || killed(p)){
+      release(&p->childlock);
       return -1;
     }
+    if(options & WNOHANG){
+      release(&p->childlock);
+      return 0;
+    }
     
     // Wait for a child to exit.
-    sleep(p, &wait_lock);  //DOC: wait-sleep
+    sleep(p, &p->childlock);  //DOC: wait-sleep
   }
 }
 
+// Fill in *ru with the resources used by the calling process,
+// as selected by who (rusage.h).
+// Return -1 if who is not valid.
+int
+getrusage(int who, struct rusage *ru)
+{
+  struct proc *pp;
+  struct proc *p = myproc();
+  struct proc *l = p->leader;
+  struct usage u;
+
+  if(who == RUSAGE_THREAD){
+    u = p->u;
+  } else if(who == RUSAGE_SELF){
+    // the running threads' counts keep changing;
+    // a snapshot is good enough.
+    acquire(&wait_lock);
+    u = l->tu;
+    for(pp = allproc; pp; pp = pp->allnext)
+      if(pp->leader == l)
+        addusage(&u, &pp->u);
+    release(&wait_lock);
+  } else if(who == RUSAGE_CHILDREN){
+    acquire(&l->tglock);
+    u = l->cu;
+    release(&l->tglock);
+  } else {
+    return -1;
+  }
+  tousage(&u, ru);
+  return 0;
+}
+
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
@@ -448,53 +1143,677 @@ scheduler(void)
   struct cpu *c = mycpu();
 
   c->proc = 0;
+  __sync_fetch_and_add(&ncpu, 1);
   for(;;){
     // The most recent process to run may have had interrupts
     // turned off; enable them to avoid a deadlock if all
     // processes are waiting.
     intr_on();
 
-    for(p = proc; p < &proc[NPROC]; p++) {
-      acquire(&p->lock);
-      if(p->state == RUNNABLE) {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        c->proc = p;
-        swtch(&c->context, &p->context);
-
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
-      }
+    if((p = pickproc(c)) != 0){
+      c->idle = 0;
+      runproc(c, p);
       release(&p->lock);
+    } else if(!c->idle){
+      // announce that this CPU is idle, then look once
+      // more, so that either kickidle() sees c->idle or
+      // we see the process it made RUNNABLE.
+      c->idle = 1;
+      __sync_synchronize();
+    } else {
+      // wait for an interrupt: a clock tick, a device,
+      // or an IPI_WAKE from kickidle(). look once more with
+      // interrupts off, so that an IPI_WAKE cannot be taken
+      // and cleared between the look and the wfi; wfi still
+      // returns when an interrupt is pending.
+      intr_off();
+      if((p = pickproc(c)) != 0){
+        c->idle = 0;
+        runproc(c, p);
+        release(&p->lock);
+      } else {
+        asm volatile("wfi");
+      }
+      intr_on();
+      c->idle = 0;
     }
   }
 }
 
-// Switch to scheduler.  Must hold only p->lock
-// and have changed proc->state. Saves and restores
-// intena because intena is a property of this
-// kernel thread, not this CPU. It should
-// be proc->intena and proc->noff, but that would
-// break in the few places where a lock is held but
-// there's no process.
-void
-sched(void)
+// Choose the next process for this CPU: the SCHED_DEADLINE
+// process with the earliest deadline, if any, then any
+// SCHED_NORMAL process holding a sleeplock that a deadline
+// process waits for, and otherwise a SCHED_NORMAL process
+// chosen by schedpolicy. Only
+// processes whose affinity includes this CPU qualify.
+// Returns it RUNNABLE with p->lock held, or 0 if there is
+// nothing to run.
+static struct proc*
+pickproc(struct cpu *c)
 {
-  int intena;
-  struct proc *p = myproc();
+  struct proc *p;
 
-  if(!holding(&p->lock))
-    panic("sched p->lock");
-  if(mycpu()->noff != 1)
-    panic("sched locks");
-  if(p->state == RUNNING)
-    panic("sched running");
+  if((p = dl_dequeue(c)) != 0 || (p = boost_dequeue(c)) != 0 ||
+     (p = schedpolicy == SCHED_CFS ? cfs_dequeue(c) : rr_dequeue(c)) != 0){
+    acquire(&p->lock);
+    if(p->state != RUNNABLE)
+      panic("pickproc: not runnable");
+    return p;
+  }
+  return 0;
+}
+
+// Should c run p in preference to leaving it for the CPU it
+// last ran on? Yes if p last ran on c, or never ran, or has
+// been waiting long enough that its cache state is cold.
+static int
+affine(struct cpu *c, struct proc *p, uint64 now)
+{
+  return p->lastcpu == c - cpus || p->lastcpu < 0 ||
+         now - p->readytime > MIGRATE_DELAY;
+}
+
+// Count a wait of delta r_time() units in histogram h.
+static void
+latcount(uint64 *h, uint64 delta)
+{
+  uint64 us = delta / (TIMEFREQ / 1000000);
+  int i;
+
+  for(i = 0; i < NLATBUCKET-1 && (us >> (i+1)) != 0; i++)
+    ;
+  h[i]++;
+}
+
+// Run p on this CPU until it gives up the CPU.
+// Caller must hold p->lock, and p must be RUNNABLE.
+static void
+runproc(struct cpu *c, struct proc *p)
+{
+  uint64 delta;
+
+  // Switch to chosen process.  It is the process's job
+  // to release its lock and then reacquire it
+  // before jumping back to us.
+  p->state = RUNNING;
+  c->proc = p;
+  p->lastrun = r_time();
+  if(p->policy != SCHED_DEADLINE)
+    latcount(p->woken ? c->latwakeup : c->latpreempt,
+             p->lastrun - p->readytime);
+  p->tstamp = p->lastrun;
+  if(p->lastcpu >= 0 && p->lastcpu != c - cpus)
+    p->migrations++;
+  p->lastcpu = c - cpus;
+  if(p->policy == SCHED_DEADLINE)
+    dl_switchin(c, p);
+  // growprocs() on another CPU flushed only its own TLB.
+  if(c->kstackgen != kstackgen){
+    c->kstackgen = kstackgen;
+    sfence_vma();
+  }
+  swtch(&c->context, &p->context);
+
+  // Process is done running for now.
+  // It should have changed its p->state before coming back.
+  c->proc = 0;
+  c->dlend = 0;
+  delta = r_time() - p->lastrun;
+  if(p->policy == SCHED_DEADLINE)
+    dl_account(p, delta);
+  else
+    p->vruntime += delta * WEIGHT_DEFAULT / effweight(p);
+
+  // yield() and preempt() leave it to us to put p back in a
+  // run queue, now that its accounting is up to date.
+  if(p->state == RUNNABLE){
+    p->woken = 0;
+    enqueue(p);
+  }
+}
+
+// p's weight, raised to any weight lent to it by processes
+// waiting for its sleeplocks.
+// Caller must hold p->lock.
+static int
+effweight(struct proc *p)
+{
+  return p->boost > p->weight ? p->boost : p->weight;
+}
+
+// Priority inheritance for sleeplocks: the caller is about
+// to sleep until owner releases a sleeplock, so lend owner
+// the caller's weight (the most, for SCHED_DEADLINE) until
+// owner has released all its sleeplocks. Otherwise owner
+// might get so little CPU time under SCHED_CFS that the
+// caller waits far longer than its own weight would have it.
+// If the caller is a deadline process, or itself runs on a
+// deadline process's behalf, a SCHED_NORMAL owner also runs
+// ahead of all other SCHED_NORMAL processes, under either
+// schedpolicy, so that the deadline process does not wait
+// on them.
+// Caller must hold the sleeplock's spinlock, so owner
+// cannot release it meanwhile.
+void
+lendweight(struct proc *owner)
+{
+  struct proc *p = myproc();
+  int w, queued;
+
+  w = p->policy == SCHED_DEADLINE ? WEIGHT_MAX : p->weight;
+  if(p->boost > w)
+    w = p->boost;
+  acquire(&owner->lock);
+  if(w > owner->boost)
+    owner->boost = w;
+  if((p->policy == SCHED_DEADLINE || p->dlboost) &&
+     owner->policy == SCHED_NORMAL && !owner->dlboost){
+    // move owner to dl.boosted if it is waiting to run.
+    queued = dequeue(owner);
+    owner->dlboost = 1;
+    if(queued){
+      enqueue(owner);
+      kickidle(owner);
+    }
+  }
+  release(&owner->lock);
+}
+
+// The caller has released its last sleeplock, so give back
+// any weight lent to it.
+void
+unlendweight(void)
+{
+  struct proc *p = myproc();
+
+  acquire(&p->lock);
+  p->boost = 0;
+  p->dlboost = 0;
+  release(&p->lock);
+}
+
+// Mark p RUNNABLE and make it visible to scheduler().
+// Caller must hold p->lock.
+static void
+setrunnable(struct proc *p)
+{
+  p->state = RUNNABLE;
+  p->woken = 1;
+  enqueue(p);
+  kickidle(p);
+  if(p->policy == SCHED_DEADLINE || p->dlboost){
+    // have the timer go off right away, so that clockintr()
+    // can preempt this CPU's process if it is less urgent.
+    w_stimecmp(r_time());
+  }
+}
+
+// If a CPU that may run p is idle, interrupt it so that it
+// does so now rather than at its next clock tick. Prefer the
+// CPU p last ran on, whose cache may still hold p's data.
+// Caller must hold p->lock, and p must be on a run queue.
+static void
+kickidle(struct proc *p)
+{
+  struct cpu *c;
+
+  // pairs with the barrier in scheduler() after c->idle = 1.
+  __sync_synchronize();
+
+  if(p->lastcpu >= 0){
+    c = &cpus[p->lastcpu];
+    if(c != mycpu() && c->idle && CANRUN(c, p)){
+      ipi_send(c - cpus, IPI_WAKE);
+      return;
+    }
+  }
+  for(c = cpus; c < &cpus[NCPU]; c++){
+    if(c != mycpu() && c->idle && CANRUN(c, p)){
+      ipi_send(c - cpus, IPI_WAKE);
+      return;
+    }
+  }
+
+  // no CPU is idle. a process that comes before SCHED_NORMAL
+  // ones should not wait for another CPU's clock tick to
+  // preempt one, so have that CPU check now. this CPU's own
+  // timer is set by setrunnable().
+  if(p->policy == SCHED_DEADLINE || p->dlboost){
+    c = 0;
+    if(p->lastcpu >= 0 && CANRUN(&cpus[p->lastcpu], p))
+      c = &cpus[p->lastcpu];
+    for(int i = 0; c == 0 && i < NCPU; i++)
+      if(CANRUN(&cpus[i], p))
+        c = &cpus[i];
+    if(c && c != mycpu())
+      ipi_send(c - cpus, IPI_RESCHED);
+  }
+}
+
+// Put RUNNABLE p on the run queue for its class.
+// Caller must hold p->lock.
+static void
+enqueue(struct proc *p)
+{
+  p->readytime = r_time();
+  if(p->policy == SCHED_DEADLINE)
+    dl_enqueue(p);
+  else if(p->dlboost)
+    boost_enqueue(p);
+  else if(schedpolicy == SCHED_CFS)
+    cfs_enqueue(p);
+  else
+    rr_enqueue(p);
+}
+
+// Take RUNNABLE p off its run queue, if it is on one, so
+// that its class or parameters can change. Returns 1 if it
+// was queued, 0 if a CPU is already about to run it.
+// Caller must hold p->lock.
+static int
+dequeue(struct proc *p)
+{
+  int r;
+
+  if(p->state != RUNNABLE)
+    return 0;
+  if(p->policy == SCHED_DEADLINE){
+    acquire(&dl.lock);
+    r = rq_remove(&dl.ready, p) || rq_remove(&dl.throttled, p);
+    release(&dl.lock);
+  } else if(p->dlboost){
+    acquire(&dl.lock);
+    r = rq_remove(&dl.boosted, p);
+    release(&dl.lock);
+  } else if(schedpolicy == SCHED_CFS){
+    acquire(&cfs.lock);
+    r = rq_remove(&cfs.head, p);
+    release(&cfs.lock);
+  } else {
+    acquire(&rr.lock);
+    r = rq_remove(&rr.head, p);
+    release(&rr.lock);
+  }
+  return r;
+}
+
+// Remove p from the run queue list *pp.
+// Returns 1 if p was on it.
+static int
+rq_remove(struct proc **pp, struct proc *p)
+{
+  for(; *pp; pp = &(*pp)->rqnext){
+    if(*pp == p){
+      *pp = p->rqnext;
+      p->rqnext = 0;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Add p to the end of the SCHED_RR run queue.
+static void
+rr_enqueue(struct proc *p)
+{
+  struct proc **pp;
+
+  acquire(&rr.lock);
+  for(pp = &rr.head; *pp; pp = &(*pp)->rqnext)
+    ;
+  p->rqnext = 0;
+  *pp = p;
+  release(&rr.lock);
+}
+
+// Remove and return the first process on the SCHED_RR run
+// queue that may run on c, skipping any that would do better
+// to wait for the CPU they last ran on. Returns 0 if there
+// is none.
+static struct proc*
+rr_dequeue(struct cpu *c)
+{
+  struct proc *p, **pp, **other;
+  uint64 now = r_time();
+
+  acquire(&rr.lock);
+  other = 0;
+  for(pp = &rr.head; *pp; pp = &(*pp)->rqnext){
+    if(!CANRUN(c, *pp))
+      continue;
+    if(affine(c, *pp, now))
+      break;
+    if(other == 0)
+      other = pp;
+  }
+  if(*pp == 0)
+    pp = other;
+  p = 0;
+  if(pp){
+    p = *pp;
+    *pp = p->rqnext;
+    p->rqnext = 0;
+  }
+  release(&rr.lock);
+  return p;
+}
+
+// Insert p into the CFS run queue, keeping it sorted.
+static void
+cfs_enqueue(struct proc *p)
+{
+  struct proc **pp;
+
+  acquire(&cfs.lock);
+  if(cfs.minvruntime > CFS_WAKEUP_CREDIT &&
+     p->vruntime < cfs.minvruntime - CFS_WAKEUP_CREDIT)
+    p->vruntime = cfs.minvruntime - CFS_WAKEUP_CREDIT;
+  for(pp = &cfs.head; *pp && (*pp)->vruntime <= p->vruntime; pp = &(*pp)->rqnext)
+    ;
+  p->rqnext = *pp;
+  *pp = p;
+  release(&cfs.lock);
+}
+
+// Remove and return the process with the smallest vruntime
+// that may run on c, skipping any that would do better to wait
+// for the CPU they last ran on. Returns 0 if there is none.
+static struct proc*
+cfs_dequeue(struct cpu *c)
+{
+  struct proc *p, **pp, **other;
+  uint64 now = r_time();
+
+  acquire(&cfs.lock);
+  other = 0;
+  for(pp = &cfs.head; *pp; pp = &(*pp)->rqnext){
+    if(!CANRUN(c, *pp))
+      continue;
+    if(affine(c, *pp, now))
+      break;
+    if(other == 0)
+      other = pp;
+  }
+  if(*pp == 0)
+    pp = other;
+  p = 0;
+  if(pp){
+    p = *pp;
+    *pp = p->rqnext;
+    p->rqnext = 0;
+    if(p->vruntime > cfs.minvruntime)
+      cfs.minvruntime = p->vruntime;
+  }
+  release(&cfs.lock);
+  return p;
+}
+
+// SCHED_DEADLINE is earliest-deadline-first with a constant
+// bandwidth server: each period a process may run for its
+// runtime, and its current job should be done by the
+// deadline. A process that uses up its runtime is throttled
+// until its next period, so it cannot hurt the others.
+
+// Start p's next period, with a full budget and a new deadline.
+// Caller must hold dl.lock.
+static void
+dl_replenish(struct proc *p, uint64 now)
+{
+  // the job did not call sched_yield() before its period ended.
+  if(!p->dl_done)
+    p->dl_misses++;
+
+  // keep periods aligned, unless p has fallen a whole period behind.
+  if(now >= p->dl_nextperiod + p->dl_period)
+    p->dl_nextperiod = now;
+  p->dl_absdeadline = p->dl_nextperiod + p->dl_deadline;
+  p->dl_nextperiod += p->dl_period;
+  p->dl_budget = p->dl_runtime;
+  p->dl_throttled = 0;
+  p->dl_done = 0;
+}
+
+// Queue RUNNABLE deadline process p: on dl.ready by deadline,
+// or on dl.throttled by next period if it has no runtime left.
+// Caller must hold p->lock.
+static void
+dl_enqueue(struct proc *p)
+{
+  struct proc **pp;
+  uint64 now = r_time();
+
+  acquire(&dl.lock);
+  if(now >= p->dl_nextperiod)
+    dl_replenish(p, now);
+  if(p->dl_throttled){
+    pp = &dl.throttled;
+    while(*pp && (*pp)->dl_nextperiod <= p->dl_nextperiod)
+      pp = &(*pp)->rqnext;
+  } else {
+    pp = &dl.ready;
+    while(*pp && (*pp)->dl_absdeadline <= p->dl_absdeadline)
+      pp = &(*pp)->rqnext;
+  }
+  p->rqnext = *pp;
+  *pp = p;
+  release(&dl.lock);
+}
+
+// Remove and return the ready deadline process with the
+// earliest deadline that may run on c, or 0 if there is none.
+static struct proc*
+dl_dequeue(struct cpu *c)
+{
+  struct proc *p, **pp;
+
+  // avoid dl.lock in the common case of no deadline processes.
+  if(dl.ready == 0)
+    return 0;
+
+  acquire(&dl.lock);
+  for(pp = &dl.ready; *pp && !CANRUN(c, *pp); pp = &(*pp)->rqnext)
+    ;
+  if((p = *pp) != 0){
+    *pp = p->rqnext;
+    p->rqnext = 0;
+  }
+  release(&dl.lock);
+  return p;
+}
+
+// Queue RUNNABLE SCHED_NORMAL process p, which holds a
+// sleeplock a deadline process waits for, at the end of
+// dl.boosted. Caller must hold p->lock.
+static void
+boost_enqueue(struct proc *p)
+{
+  struct proc **pp;
+
+  acquire(&dl.lock);
+  for(pp = &dl.boosted; *pp; pp = &(*pp)->rqnext)
+    ;
+  p->rqnext = 0;
+  *pp = p;
+  release(&dl.lock);
+}
+
+// Remove and return the first process on dl.boosted that may
+// run on c, or 0 if there is none.
+static struct proc*
+boost_dequeue(struct cpu *c)
+{
+  struct proc *p, **pp;
+
+  // avoid dl.lock in the common case of no boosted processes.
+  if(dl.boosted == 0)
+    return 0;
+
+  acquire(&dl.lock);
+  for(pp = &dl.boosted; *pp && !CANRUN(c, *pp); pp = &(*pp)->rqnext)
+    ;
+  if((p = *pp) != 0){
+    *pp = p->rqnext;
+    p->rqnext = 0;
+  }
+  release(&dl.lock);
+  return p;
+}
+
+// Deadline process p is about to run on c: arrange for the
+// timer to go off when p's runtime for this period runs out.
+static void
+dl_switchin(struct cpu *c, struct proc *p)
+{
+  acquire(&dl.lock);
+  c->dlend = p->lastrun + p->dl_budget;
+  release(&dl.lock);
+  if(c->dlend < r_stimecmp())
+    w_stimecmp(c->dlend);
+}
+
+// Charge deadline process p for delta of CPU time, and
+// throttle it if that used up its runtime.
+static void
+dl_account(struct proc *p, uint64 delta)
+{
+  acquire(&dl.lock);
+  if(delta >= p->dl_budget){
+    p->dl_budget = 0;
+    p->dl_throttled = 1;
+  } else {
+    p->dl_budget -= delta;
+  }
+  release(&dl.lock);
+}
+
+// Called by clockintr() on every CPU. Moves throttled deadline
+// processes whose next period has begun to dl.ready, and sets
+// *next to the time of the next deadline event that concerns
+// this CPU. Returns 1 if this CPU's process should yield to a
+// more urgent deadline process, or to a process on dl.boosted.
+int
+dl_timer(uint64 now, uint64 *next)
+{
+  struct cpu *c = mycpu();
+  struct proc *p, **pp;
+  int preempt = 0;
+
+  *next = ~0L;
+  if(dl.ready == 0 && dl.throttled == 0 && dl.boosted == 0 && c->dlend == 0)
+    return 0;
+
+  acquire(&dl.lock);
+  while((p = dl.throttled) != 0 && p->dl_nextperiod <= now){
+    dl.throttled = p->rqnext;
+    dl_replenish(p, now);
+    pp = &dl.ready;
+    while(*pp && (*pp)->dl_absdeadline <= p->dl_absdeadline)
+      pp = &(*pp)->rqnext;
+    p->rqnext = *pp;
+    *pp = p;
+  }
+  if(dl.throttled)
+    *next = dl.throttled->dl_nextperiod;
+
+  // the most urgent process that this CPU could run.
+  for(p = dl.ready; p && !CANRUN(c, p); p = p->rqnext)
+    ;
+
+  if(c->dlend){
+    // this CPU is running a deadline process.
+    if(now >= c->dlend)
+      preempt = 1;      // out of runtime
+    else if(c->dlend < *next)
+      *next = c->dlend;
+    if(p && p->dl_absdeadline < c->proc->dl_absdeadline)
+      preempt = 1;
+  } else if(p && c->proc){
+    // deadline processes come before all SCHED_NORMAL ones.
+    preempt = 1;
+  } else if(c->proc && !c->proc->dlboost){
+    // and so do processes they wait for.
+    for(p = dl.boosted; p && !CANRUN(c, p); p = p->rqnext)
+      ;
+    if(p)
+      preempt = 1;
+  }
+  release(&dl.lock);
+  return preempt;
+}
+
+// Make p a deadline process with the given parameters, in
+// r_time() units, if the CPUs have enough bandwidth left for
+// it. Returns 0, or -1 if admission control turns p away.
+// Caller must hold p->lock, and p must not be queued.
+static int
+dl_admit(struct proc *p, uint64 runtime, uint64 deadline, uint64 period)
+{
+  uint64 bw, now;
+
+  bw = (runtime << DL_BWSHIFT) / period;
+  acquire(&dl.lock);
+  if(dl.bw - p->dl_bw + bw > ncpu * DL_BWMAX){
+    release(&dl.lock);
+    return -1;
+  }
+  dl.bw = dl.bw - p->dl_bw + bw;
+  p->dl_bw = bw;
+  p->dl_runtime = runtime;
+  p->dl_deadline = deadline;
+  p->dl_period = period;
+
+  // the first period starts now.
+  now = r_time();
+  p->dl_budget = runtime;
+  p->dl_absdeadline = now + deadline;
+  p->dl_nextperiod = now + period;
+  p->dl_throttled = 0;
+  p->dl_done = 0;
+  p->dl_misses = 0;
+  p->policy = SCHED_DEADLINE;
+  release(&dl.lock);
+  return 0;
+}
+
+// Return p to SCHED_NORMAL, giving back its deadline bandwidth.
+// Caller must hold p->lock, and p must not be queued.
+static void
+dl_leave(struct proc *p)
+{
+  acquire(&dl.lock);
+  dl.bw -= p->dl_bw;
+  p->dl_bw = 0;
+  p->policy = SCHED_NORMAL;
+  release(&dl.lock);
+}
+
+// Switch to scheduler.  Must hold only p->lock
+// and have changed proc->state. Saves and restores
+// intena because intena is a property of this
+// kernel thread, not this CPU. It should
+// be proc->intena and proc->noff, but that would
+// break in the few places where a lock is held but
+// there's no process.
+void
+sched(void)
+{
+  int intena;
+  struct proc *p = myproc();
+
+  if(!holding(&p->lock))
+    panic("sched p->lock");
+  if(mycpu()->noff != 1)
+    panic("sched locks");
+  if(p->state == RUNNING)
+    panic("sched running");
   if(intr_get())
     panic("sched interruptible");
 
+  // runproc() restarts the clock when p next runs.
+  p->u.stime += r_time() - p->tstamp;
+
+  fpswitchout(p);
+
   intena = mycpu()->intena;
   swtch(&p->context, &mycpu()->context);
   mycpu()->intena = intena;
@@ -506,6 +1825,20 @@ yield(void)
 {
   struct proc *p = myproc();
   acquire(&p->lock);
+  p->u.nvcsw++;
+  p->state = RUNNABLE;
+  sched();
+  release(&p->lock);
+}
+
+// Like yield(), but because a timer interrupt
+// says p has had the CPU long enough.
+void
+preempt(void)
+{
+  struct proc *p = myproc();
+  acquire(&p->lock);
+  p->u.nivcsw++;
   p->state = RUNNABLE;
   sched();
   release(&p->lock);
@@ -535,12 +1868,44 @@ forkret(void)
   usertrapret();
 }
 
+// The sleep queue for chan.
+static struct sleepq*
+sleepqueue(void *chan)
+{
+  return &sleepq[(uint64)chan % NSLEEPQ];
+}
+
+// Take p off its sleep queue.
+// Caller must hold the sleep queue's lock.
+static void
+sqremove(struct proc *p)
+{
+  *p->sqprev = p->sqnext;
+  if(p->sqnext)
+    p->sqnext->sqprev = p->sqprev;
+  p->sqnext = 0;
+  p->sqprev = 0;
+  p->sqchan = 0;
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct sleepq *sq = sleepqueue(chan);
+
+  // join chan's sleep queue while still holding lk,
+  // so that a wakeup() by a holder of lk finds p there.
+  acquire(&sq->lock);
+  p->sqchan = chan;
+  p->sqnext = sq->head;
+  if(sq->head)
+    sq->head->sqprev = &p->sqnext;
+  p->sqprev = &sq->head;
+  sq->head = p;
+  release(&sq->lock);
   
   // Must acquire p->lock in order to
   // change p->state and then call sched.
@@ -555,14 +1920,22 @@ sleep(void *chan, struct spinlock *lk)
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  p->u.nvcsw++;
 
   sched();
 
   // Tidy up.
   p->chan = 0;
+  release(&p->lock);
+
+  // wakeup() takes p off the queue, but kill() and
+  // wakeproc() leave it to p.
+  acquire(&sq->lock);
+  if(p->sqprev)
+    sqremove(p);
+  release(&sq->lock);
 
   // Reacquire original lock.
-  release(&p->lock);
   acquire(lk);
 }
 
@@ -571,17 +1944,34 @@ sleep(void *chan, struct spinlock *lk)
 void
 wakeup(void *chan)
 {
-  struct proc *p;
+  wakeupn(chan, NPROC);
+}
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    if(p != myproc()){
-      acquire(&p->lock);
-      if(p->state == SLEEPING && p->chan == chan) {
-        p->state = RUNNABLE;
-      }
-      release(&p->lock);
+// Wake up at most n processes sleeping on chan.
+// Must be called without any p->lock.
+// Returns the number woken.
+int
+wakeupn(void *chan, int n)
+{
+  struct sleepq *sq = sleepqueue(chan);
+  struct proc *p, *np;
+  int woken = 0;
+
+  acquire(&sq->lock);
+  for(p = sq->head; p && woken < n; p = np) {
+    np = p->sqnext;
+    if(p->sqchan != chan || p == myproc())
+      continue;
+    acquire(&p->lock);
+    if(p->state == SLEEPING && p->chan == chan) {
+      sqremove(p);
+      setrunnable(p);
+      woken++;
     }
+    release(&p->lock);
   }
+  release(&sq->lock);
+  return woken;
 }
 
 // Kill the process with the given pid.
@@ -592,20 +1982,15 @@ kill(int pid)
 {
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++){
-    acquire(&p->lock);
-    if(p->pid == pid){
-      p->killed = 1;
-      if(p->state == SLEEPING){
-        // Wake process from sleep().
-        p->state = RUNNABLE;
-      }
-      release(&p->lock);
-      return 0;
-    }
-    release(&p->lock);
+  if((p = pidlookup(pid)) == 0)
+    return -1;
+  p->killed = 1;
+  if(p->state == SLEEPING){
+    // Wake process from sleep().
+    setrunnable(p);
   }
-  return -1;
+  release(&p->lock);
+  return 0;
 }
 
 void
@@ -627,6 +2012,176 @@ killed(struct proc *p)
   return k;
 }
 
+// Return the process with the given pid, or the calling
+// process if pid is 0, with p->lock held.
+// Return 0 if there is no such process.
+static struct proc*
+findproc(int pid)
+{
+  struct proc *p;
+
+  if(pid == 0){
+    p = myproc();
+    acquire(&p->lock);
+    return p;
+  }
+  return pidlookup(pid);
+}
+
+// Set the scheduling parameters of process pid (0 for the
+// caller). Returns 0, or -1 for a bad pid or parameters, or
+// if there is not enough CPU time left for a deadline process.
+int
+setschedattr(int pid, struct sched_attr *attr)
+{
+  struct proc *p;
+  int queued, r = 0;
+
+  if(attr->weight < WEIGHT_MIN || attr->weight > WEIGHT_MAX)
+    return -1;
+  if(attr->policy == SCHED_DEADLINE){
+    if(attr->runtime == 0 || attr->runtime > attr->deadline ||
+       attr->deadline > attr->period || attr->period > DL_PERIOD_MAX)
+      return -1;
+  } else if(attr->policy != SCHED_NORMAL){
+    return -1;
+  }
+  if((p = findproc(pid)) == 0)
+    return -1;
+
+  // move p to the run queue for its new class.
+  queued = dequeue(p);
+  p->weight = attr->weight;
+  if(attr->policy == SCHED_DEADLINE){
+    r = dl_admit(p, attr->runtime * (TIMEFREQ / 1000000),
+                 attr->deadline * (TIMEFREQ / 1000000),
+                 attr->period * (TIMEFREQ / 1000000));
+  } else if(p->policy == SCHED_DEADLINE){
+    dl_leave(p);
+  }
+  if(queued)
+    enqueue(p);
+  release(&p->lock);
+
+  // start running under the new parameters.
+  if(r == 0 && p == myproc())
+    yield();
+  return r;
+}
+
+// Fetch the scheduling parameters of process pid (0 for
+// the caller). Returns 0, or -1 if there is no such process.
+int
+getschedattr(int pid, struct sched_attr *attr)
+{
+  struct proc *p;
+
+  if((p = findproc(pid)) == 0)
+    return -1;
+  memset(attr, 0, sizeof(*attr));
+  attr->policy = p->policy;
+  attr->weight = p->weight;
+  attr->vruntime = p->vruntime;
+  attr->migrations = p->migrations;
+  if(p->policy == SCHED_DEADLINE){
+    acquire(&dl.lock);
+    attr->runtime = p->dl_runtime / (TIMEFREQ / 1000000);
+    attr->deadline = p->dl_deadline / (TIMEFREQ / 1000000);
+    attr->period = p->dl_period / (TIMEFREQ / 1000000);
+    attr->misses = p->dl_misses;
+    release(&dl.lock);
+  }
+  release(&p->lock);
+  return 0;
+}
+
+// Set the CPUs that process pid (0 for the caller) may run
+// on: bit i of mask for CPU i. Returns 0, or -1 for a bad
+// pid or a mask with none of the running CPUs.
+int
+setaffinity(int pid, uint64 mask)
+{
+  struct proc *p;
+
+  if(ncpu < 64 && (mask & ((1L << ncpu) - 1)) == 0)
+    return -1;
+  if((p = findproc(pid)) == 0)
+    return -1;
+  // p is on a shared run queue, if any, so it need not move.
+  p->affinity = mask;
+  release(&p->lock);
+
+  // get off this CPU if it is no longer allowed.
+  if(p == myproc())
+    yield();
+  return 0;
+}
+
+// Fetch the CPU mask of process pid (0 for the caller).
+// Returns 0, or -1 if there is no such process.
+int
+getaffinity(int pid, uint64 *mask)
+{
+  struct proc *p;
+
+  if((p = findproc(pid)) == 0)
+    return -1;
+  *mask = p->affinity;
+  release(&p->lock);
+  return 0;
+}
+
+// Copy CPU cpu's scheduling latency histograms to *sl, or
+// the sum over all CPUs if cpu is -1. With SCHEDLAT_RESET
+// in flags, also zero them. The scheduler updates them
+// without a lock, so a count may be missed while resetting.
+// Returns 0, or -1 if cpu is not valid.
+int
+schedlat(int cpu, struct schedlat *sl, int flags)
+{
+  struct cpu *c;
+  int i;
+
+  if(cpu < -1 || cpu >= NCPU)
+    return -1;
+  memset(sl, 0, sizeof(*sl));
+  for(c = cpus; c < &cpus[NCPU]; c++){
+    if(cpu != -1 && c != &cpus[cpu])
+      continue;
+    for(i = 0; i < NLATBUCKET; i++){
+      sl->wakeup[i] += c->latwakeup[i];
+      sl->preempt[i] += c->latpreempt[i];
+    }
+    if(flags & SCHEDLAT_RESET){
+      memset(c->latwakeup, 0, sizeof(c->latwakeup));
+      memset(c->latpreempt, 0, sizeof(c->latpreempt));
+    }
+  }
+  return 0;
+}
+
+// Give up the CPU. A SCHED_DEADLINE process has finished
+// its current job, and waits for its next period.
+void
+schedyield(void)
+{
+  struct proc *p = myproc();
+
+  acquire(&p->lock);
+  if(p->policy == SCHED_DEADLINE){
+    acquire(&dl.lock);
+    if(r_time() > p->dl_absdeadline)
+      p->dl_misses++;
+    p->dl_done = 1;
+    p->dl_throttled = 1;
+    release(&dl.lock);
+  }
+  p->u.nvcsw++;
+  p->state = RUNNABLE;
+  sched();
+  release(&p->lock);
+}
+
 // Copy to either a user address, or kernel address,
 // depending on usr_dst.
 // Returns 0 on success, -1 on error.
@@ -675,7 +2230,7 @@ procdump(void)
   char *state;
 
   printf("\n");
-  for(p = proc; p < &proc[NPROC]; p++){
+  for(p = allproc; p; p = p->allnext){
     if(p->state == UNUSED)
       continue;
     if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
@@ -683,6 +2238,9 @@ procdump(void)
     else
       state = "???";
     printf("%d %s %s", p->pid, state, p->name);
+    printf(" usr %lums sys %lums vcsw %d ivcsw %d flt %d",
+           p->u.utime / (TIMEFREQ / 1000), p->u.stime / (TIMEFREQ / 1000),
+           p->u.nvcsw, p->u.nivcsw, p->u.nfault);
     printf("\n");
   }
 }
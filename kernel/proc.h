@@ -24,10 +24,30 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  uint64 nexttick;            // r_time() of the next clock tick.
+  uint64 dlend;               // When the running deadline process runs out, or 0.
+  uint64 ntrap;               // User TLB flushes, by traps, returns or IPIs, for tlbshootdown().
+  uint64 kstackgen;           // kstackgen as of this CPU's last kernel TLB flush.
+  struct mcsnode mcs[NMCS];   // Places in line for SPIN_MCS locks.
+  uint mcsbusy;               // Bit i set if mcs[i] is in use.
+  struct proc *fpproc;        // Whose floating-point registers this CPU holds.
+  struct proc *vproc;         // Whose vector registers this CPU holds.
+  int idle;                   // In scheduler(), with nothing to run; may be in wfi.
+  int ipi;                    // IPI_* requests from other CPUs.
+  uint64 latwakeup[NLATBUCKET];  // Scheduling latency histograms; see
+  uint64 latpreempt[NLATBUCKET]; // struct schedlat in sched.h.
 };
 
 extern struct cpu cpus[NCPU];
 
+// requests carried by inter-processor interrupts (ipi.c).
+#define IPI_WAKE 1   // leave wfi and look for a process to run
+#define IPI_TLB  2   // flush the TLB
+#define IPI_RESCHED 4  // check at once whether to preempt for deadline work
+
+// largest vector register, in bytes, that fits in the trapframe.
+#define MAXVLENB 64
+
 // per-process data for the trap handling code in trampoline.S.
 // sits in a page by itself just under the trampoline page in the
 // user page table. not specially mapped in the kernel page table.
@@ -77,10 +97,31 @@ struct trapframe {
   /* 264 */ uint64 t4;
   /* 272 */ uint64 t5;
   /* 280 */ uint64 t6;
+
+  // trampoline.S does not touch the rest. fpu.c saves
+  // and restores the user's floating-point and vector
+  // registers here only when the process uses them.
+  /* 288 */ uint64 f[32];
+  /* 544 */ uint64 fcsr;
+  /* 552 */ uint64 vstart;
+  /* 560 */ uint64 vl;
+  /* 568 */ uint64 vtype;
+  /* 576 */ uint64 vcsr;
+  /* 584 */ uchar v[32*MAXVLENB];  // v0-v31, vlenb bytes each
 };
 
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+// Resource usage, as reported by getrusage() (rusage.h),
+// but with times in r_time() units.
+struct usage {
+  uint64 utime;
+  uint64 stime;
+  int nvcsw;
+  int nivcsw;
+  int nfault;
+};
+
 // Per-process state
 struct proc {
   struct spinlock lock;
@@ -91,17 +132,79 @@ struct proc {
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  int weight;                  // CPU share under SCHED_CFS (sched.h)
+  uint64 vruntime;             // Weighted time on the CPU, for SCHED_CFS
+  uint64 lastrun;              // r_time() when last switched in
+  int policy;                  // Scheduling class (sched.h)
+  uint64 affinity;             // Bit i set if p may run on CPU i
+  int lastcpu;                 // CPU p last ran on, or -1
+  int migrations;              // Times p ran on a different CPU than before
+  uint64 readytime;            // r_time() when p last became RUNNABLE
+  int woken;                   // Made RUNNABLE by setrunnable(), not by giving up the CPU
+  int boost;                   // Weight lent by sleeplock waiters, or 0
+  int dlboost;                 // A SCHED_DEADLINE process waits for p's sleeplocks
+
+  // dl.lock must be held when using these SCHED_DEADLINE
+  // parameters and state, all in r_time() units:
+  uint64 dl_runtime;           // CPU time allowed each period
+  uint64 dl_deadline;          // Job due this long after its period starts
+  uint64 dl_period;
+  uint64 dl_bw;                // Share of a CPU reserved, runtime/period
+  uint64 dl_budget;            // CPU time left in this period
+  uint64 dl_absdeadline;       // When the current job is due
+  uint64 dl_nextperiod;        // When the next period starts
+  int dl_throttled;            // Out of budget until dl_nextperiod
+  int dl_done;                 // Current job finished with sched_yield()
+  int dl_misses;               // Jobs that missed their deadline
+
+  // updated only by p itself, with p->lock held or in a trap:
+  struct usage u;              // Resources used so far
+  uint64 tstamp;               // r_time() when u.utime or u.stime last grew
 
-  // wait_lock must be held when using this:
-  struct proc *parent;         // Parent process
+  // the run queue lock must be held when using this:
+  struct proc *rqnext;         // Next process in the run queue
+
+  // the sleep queue lock must be held when using these:
+  void *sqchan;                // Channel of the sleep queue p is on, or 0
+  struct proc *sqnext;         // Next in the sleep queue
+  struct proc **sqprev;        // What points to p in the sleep queue
+
+  // the parent's childlock must be held when using these:
+  struct proc *parent;         // Parent process; 0 for a thread
+  struct proc *sibnext;        // Next in parent's children or zombies
+  struct proc **sibprev;       // What points to p in that list
+
+  // childlock must be held when using these:
+  struct spinlock childlock;   // before any p->lock
+  struct proc *children;       // Children that have not exited
+  struct proc *zombies;        // Exited children, for wait()
+
+  // wait_lock must be held when using these:
+  struct proc *leader;         // First thread of the process; p itself if none other
+  uint tslots;                 // In a leader: THREADFRAME slots in use
+  struct usage tu;             // In a leader: used by threads that have exited
+
+  // in a leader, shared by the process's threads:
+  struct spinlock tglock;      // protects vmbusy, ofile, cwd, cu; before any p->lock
+  int vmbusy;                  // A thread is changing sz or the page table
+  struct usage cu;             // Used by children that have been waited for
 
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
-  uint64 sz;                   // Size of process memory (bytes)
-  pagetable_t pagetable;       // User page table
+  uint64 sz;                   // Size of process memory (bytes), in the leader
+  pagetable_t pagetable;       // User page table, shared by all threads
   struct trapframe *trapframe; // data page for trampoline.S
+  struct ushared *ushared;     // page user code may read, at tfva - PGSIZE
+  uint64 tfva;                 // User virtual address of trapframe
+  int fpcpu;                   // CPU holding p's latest FP registers, or -1
+  int vcpu;                    // CPU holding p's latest vector registers, or -1
+  int nsleeplocks;             // Sleeplocks held, as writer for rwsleeplocks
   struct context context;      // swtch() here to run process
-  struct file *ofile[NOFILE];  // Open files
-  struct inode *cwd;           // Current directory
+  struct file *ofile[NOFILE];  // Open files, in the leader
+  struct inode *cwd;           // Current directory, in the leader
   char name[16];               // Process name (debugging)
+
+  // pid_lock must be held when using these:
+  struct proc *next;           // Next in pid hash chain, or free list
+  struct proc *allnext;        // Next in allproc; set once
 };
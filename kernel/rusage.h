@@ -0,0 +1,19 @@
+// Resource usage of a process, for getrusage() and wait4().
+// Both the kernel and user programs use this header file.
+
+// who argument to getrusage().
+#define RUSAGE_SELF      0    // all threads of the calling process
+#define RUSAGE_CHILDREN  (-1) // children that have exited and been waited for
+#define RUSAGE_THREAD    1    // the calling thread only
+
+// options argument to wait4().
+#define WNOHANG  1   // return 0 rather than wait if no child has exited
+
+// times are in microseconds.
+struct rusage {
+  uint64 utime;        // CPU time in user space
+  uint64 stime;        // CPU time in the kernel
+  int nvcsw;           // voluntary context switches (sleep, yield)
+  int nivcsw;          // involuntary context switches (preemption)
+  int nfault;          // page faults
+};
@@ -0,0 +1,50 @@
+// Scheduling policies and per-process scheduling parameters.
+// Both the kernel and user programs use this header file.
+
+// How the scheduler picks among SCHED_NORMAL processes.
+// Chosen at boot; see SCHEDULER in param.h.
+#define SCHED_RR      0   // round-robin, in the order processes become runnable
+#define SCHED_CFS     1   // fair share by weighted virtual runtime
+
+// Scheduling class of a process.
+#define SCHED_NORMAL    0
+#define SCHED_DEADLINE  1   // earliest deadline first, ahead of SCHED_NORMAL
+
+// CPU share of a SCHED_NORMAL process under SCHED_CFS.
+// A process with twice the weight of another gets twice
+// as much CPU time when both are runnable.
+#define WEIGHT_DEFAULT 1024
+#define WEIGHT_MIN     16
+#define WEIGHT_MAX     (64*1024)
+
+// argument to sched_setattr() and sched_getattr().
+// times are in microseconds.
+struct sched_attr {
+  int policy;          // scheduling class, SCHED_NORMAL or SCHED_DEADLINE
+  int weight;          // WEIGHT_MIN..WEIGHT_MAX
+  uint64 vruntime;     // weighted time on the CPU (read-only)
+
+  // SCHED_DEADLINE: run for up to runtime every period, and
+  // finish each job (by calling sched_yield()) within
+  // deadline of the start of its period.
+  // runtime <= deadline <= period.
+  uint64 runtime;
+  uint64 deadline;
+  uint64 period;
+  int misses;          // jobs that missed their deadline (read-only)
+
+  int migrations;      // times moved to another CPU (read-only)
+};
+
+// scheduling latency histograms, from schedlat().
+// count[i] is how many times a process waited between
+// 2^i and 2^(i+1) microseconds (under 2 for i = 0) from
+// becoming RUNNABLE until a CPU ran it. SCHED_DEADLINE
+// processes are left out, since they may wait on purpose.
+struct schedlat {
+  uint64 wakeup[NLATBUCKET];   // after wakeup() or fork()
+  uint64 preempt[NLATBUCKET];  // after giving up the CPU while RUNNABLE
+};
+
+// flags for schedlat().
+#define SCHEDLAT_RESET 1   // zero the histograms after reading them
@@ -9,24 +9,73 @@
 #include "proc.h"
 #include "sleeplock.h"
 
+// Sleeplocks mostly guard short critical sections, so while
+// the holder is running on another CPU, spin for up to
+// SLEEPSPIN microseconds in the hope that it releases the
+// lock, rather than pay for sleeping and being woken.
+// *held says whether the lock is still held, and *owner by
+// whom. Procs are never freed, so *owner may be read even if
+// it exits meanwhile. Called and returns with lk held.
+static void
+spinowner(struct spinlock *lk, uint *held, struct proc **owner)
+{
+  uint64 end = r_time() + SLEEPSPIN * (TIMEFREQ / 1000000);
+  struct proc *p;
+
+  release(lk);
+  while(__atomic_load_n(held, __ATOMIC_RELAXED) && r_time() < end){
+    p = __atomic_load_n(owner, __ATOMIC_RELAXED);
+    if(p == 0 || __atomic_load_n(&p->state, __ATOMIC_RELAXED) != RUNNING)
+      break;
+  }
+  acquire(lk);
+}
+
+// The caller has released a sleeplock (or an rwsleeplock it
+// held as writer). Once it holds none, it no longer needs
+// weight lent to it by waiters.
+static void
+released(void)
+{
+  struct proc *p = myproc();
+
+  if(--p->nsleeplocks == 0 && p->boost)
+    unlendweight();
+}
+
 void
 initsleeplock(struct sleeplock *lk, char *name)
 {
   initlock(&lk->lk, "sleep lock");
   lk->name = name;
   lk->locked = 0;
+  lk->owner = 0;
   lk->pid = 0;
+  lk->cls = lockclass(name, 1);
 }
 
 void
 acquiresleep(struct sleeplock *lk)
 {
+  int contended;
+  uint64 t0, wait = 0;
+
   acquire(&lk->lk);
-  while (lk->locked) {
-    sleep(lk, &lk->lk);
+  contended = lk->locked;
+  if(contended){
+    t0 = r_time();
+    spinowner(&lk->lk, &lk->locked, &lk->owner);
+    while (lk->locked) {
+      lendweight(lk->owner);
+      sleep(lk, &lk->lk);
+    }
+    wait = r_time() - t0;
   }
+  lockcount(lk->cls, contended, wait);
   lk->locked = 1;
+  lk->owner = myproc();
   lk->pid = myproc()->pid;
+  myproc()->nsleeplocks++;
   release(&lk->lk);
 }
 
@@ -35,9 +84,11 @@ releasesleep(struct sleeplock *lk)
 {
   acquire(&lk->lk);
   lk->locked = 0;
+  lk->owner = 0;
   lk->pid = 0;
   wakeup(lk);
   release(&lk->lk);
+  released();
 }
 
 int
@@ -51,5 +102,106 @@ holdingsleep(struct sleeplock *lk)
   return r;
 }
 
+void
+initrwsleeplock(struct rwsleeplock *lk, char *name)
+{
+  initlock(&lk->lk, "rw sleep lock");
+  lk->name = name;
+  lk->readers = 0;
+  lk->writer = 0;
+  lk->wwait = 0;
+  lk->owner = 0;
+  lk->pid = 0;
+  lk->cls = lockclass(name, 1);
+}
 
+// Acquire lk shared with other readers.
+void
+acquireread(struct rwsleeplock *lk)
+{
+  int contended;
+  uint64 t0, wait = 0;
 
+  acquire(&lk->lk);
+  contended = lk->writer || lk->wwait;
+  if(contended){
+    t0 = r_time();
+    if(lk->writer)
+      spinowner(&lk->lk, &lk->writer, &lk->owner);
+    while(lk->writer || lk->wwait){
+      if(lk->writer)
+        lendweight(lk->owner);
+      sleep(lk, &lk->lk);
+    }
+    wait = r_time() - t0;
+  }
+  lockcount(lk->cls, contended, wait);
+  lk->readers++;
+  release(&lk->lk);
+}
+
+void
+releaseread(struct rwsleeplock *lk)
+{
+  acquire(&lk->lk);
+  if(lk->readers == 0)
+    panic("releaseread");
+  if(--lk->readers == 0)
+    wakeup(lk);
+  release(&lk->lk);
+}
+
+// Acquire lk exclusively.
+void
+acquirewrite(struct rwsleeplock *lk)
+{
+  int contended;
+  uint64 t0, wait = 0;
+
+  acquire(&lk->lk);
+  contended = lk->writer || lk->readers;
+  if(contended){
+    t0 = r_time();
+    // readers cannot be spun for or boosted: there is
+    // no one owner.
+    if(lk->writer)
+      spinowner(&lk->lk, &lk->writer, &lk->owner);
+    lk->wwait++;
+    while(lk->writer || lk->readers){
+      if(lk->writer)
+        lendweight(lk->owner);
+      sleep(lk, &lk->lk);
+    }
+    lk->wwait--;
+    wait = r_time() - t0;
+  }
+  lockcount(lk->cls, contended, wait);
+  lk->writer = 1;
+  lk->owner = myproc();
+  lk->pid = myproc()->pid;
+  myproc()->nsleeplocks++;
+  release(&lk->lk);
+}
+
+void
+releasewrite(struct rwsleeplock *lk)
+{
+  acquire(&lk->lk);
+  lk->writer = 0;
+  lk->owner = 0;
+  lk->pid = 0;
+  wakeup(lk);
+  release(&lk->lk);
+  released();
+}
+
+int
+holdingwrite(struct rwsleeplock *lk)
+{
+  int r;
+
+  acquire(&lk->lk);
+  r = lk->writer && (lk->pid == myproc()->pid);
+  release(&lk->lk);
+  return r;
+}
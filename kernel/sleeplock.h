@@ -2,9 +2,27 @@
 struct sleeplock {
   uint locked;       // Is the lock held?
   struct spinlock lk; // spinlock protecting this sleep lock
+  struct proc *owner; // Process holding lock, to spin for or boost
   
   // For debugging:
   char *name;        // Name of lock.
   int pid;           // Process holding lock
+  int cls;           // Lock class, for lockstat().
+};
+
+// Long-term lock that many readers may hold at once,
+// or one writer. Waiting writers hold off new readers,
+// so that a stream of readers cannot starve a writer.
+struct rwsleeplock {
+  uint readers;      // Number of readers holding the lock
+  uint writer;       // Is the lock held by a writer?
+  uint wwait;        // Writers waiting for the lock
+  struct spinlock lk; // spinlock protecting this sleep lock
+  struct proc *owner; // Writer holding lock, to spin for or boost
+
+  // For debugging:
+  char *name;        // Name of lock.
+  int pid;           // Writer holding lock
+  int cls;           // Lock class, for lockstat().
 };
 
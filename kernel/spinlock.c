@@ -6,31 +6,191 @@
 #include "spinlock.h"
 #include "riscv.h"
 #include "proc.h"
+#include "lockstat.h"
 #include "defs.h"
 
+// Lock contention statistics. Each lock belongs to the
+// class of locks with its name; class 0 is for locks that
+// were never initialized or did not fit in the table.
+// Each CPU counts in its own row of counts[], with
+// interrupts off, so that counting costs no atomic
+// operations or shared cache lines.
+struct lockclass {
+  char *name;
+  int sleep;
+};
+static struct lockclass classes[NLOCKCLASS] = { { "other", 0 } };
+static int nclass = 1;
+static uint classlock;  // protects classes[] and nclass
+
+struct lockcounts {
+  uint64 nacquire;
+  uint64 ncontended;
+  uint64 wait;          // r_time() units
+};
+static struct lockcounts counts[NCPU][NLOCKCLASS];
+
+// Return the class for locks called name, of the kind
+// sleep says, adding it if need be.
+int
+lockclass(char *name, int sleep)
+{
+  int i;
+
+  // a bare lock, since a spinlock would count itself.
+  push_off();
+  while(__sync_lock_test_and_set(&classlock, 1) != 0)
+    ;
+  for(i = 1; i < nclass; i++)
+    if(classes[i].sleep == sleep && strncmp(classes[i].name, name, 16) == 0)
+      break;
+  if(i == nclass){
+    if(nclass < NLOCKCLASS){
+      classes[i].name = name;
+      classes[i].sleep = sleep;
+      nclass++;
+    } else {
+      i = 0;
+    }
+  }
+  __sync_lock_release(&classlock);
+  pop_off();
+  return i;
+}
+
+// Count an acquisition of a lock of class cls, which waited
+// for wait r_time() units if contended.
+// Interrupts must be off.
+void
+lockcount(int cls, int contended, uint64 wait)
+{
+  struct lockcounts *lc = &counts[cpuid()][cls];
+
+  lc->nacquire++;
+  if(contended){
+    lc->ncontended++;
+    lc->wait += wait;
+  }
+}
+
+// Copy out up to n struct lockstats, one per lock class,
+// to user address addr. With LOCKSTAT_RESET in flags, also
+// zero the counts. Returns the number copied, or -1.
+int
+lockstat(uint64 addr, int n, int flags)
+{
+  struct lockstat ls;
+  struct lockcounts *lc;
+  int i, cpu;
+
+  for(i = 0; i < nclass && i < n; i++){
+    memset(&ls, 0, sizeof(ls));
+    safestrcpy(ls.name, classes[i].name, sizeof(ls.name));
+    ls.sleep = classes[i].sleep;
+    for(cpu = 0; cpu < NCPU; cpu++){
+      lc = &counts[cpu][i];
+      ls.nacquire += lc->nacquire;
+      ls.ncontended += lc->ncontended;
+      ls.wait += lc->wait;
+    }
+    ls.wait /= TIMEFREQ / 1000000;
+    if(copyout(myproc()->pagetable, addr + i*sizeof(ls), (char*)&ls, sizeof(ls)) < 0)
+      return -1;
+  }
+  // the CPUs keep counting meanwhile, so a few may be lost.
+  if(flags & LOCKSTAT_RESET)
+    memset(counts, 0, sizeof(counts));
+  return i;
+}
+
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
   lk->locked = 0;
+  lk->next = 0;
+  lk->owner = 0;
+  lk->tail = 0;
+  lk->node = 0;
   lk->cpu = 0;
+  lk->cls = lockclass(name, 0);
 }
 
+#if SPINLOCK == SPIN_MCS
+// Take a free mcsnode of this CPU's. Interrupts are off.
+static struct mcsnode*
+mcsalloc(struct cpu *c)
+{
+  int i;
+
+  for(i = 0; i < NMCS; i++){
+    if((c->mcsbusy & (1 << i)) == 0){
+      c->mcsbusy |= 1 << i;
+      return &c->mcs[i];
+    }
+  }
+  panic("mcsalloc");
+}
+#endif
+
 // Acquire the lock.
 // Loops (spins) until the lock is acquired.
 void
 acquire(struct spinlock *lk)
 {
+  int contended = 0;
+  uint64 t0, wait = 0;
+
   push_off(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
+#if SPINLOCK == SPIN_TICKET
+  // take a ticket, and wait for it to be called. each
+  // release() calls the next one, so waiters get the
+  // lock in the order they arrived.
+  uint t = __atomic_fetch_add(&lk->next, 1, __ATOMIC_RELAXED);
+  if(__atomic_load_n(&lk->owner, __ATOMIC_ACQUIRE) != t){
+    contended = 1;
+    t0 = r_time();
+    while(__atomic_load_n(&lk->owner, __ATOMIC_ACQUIRE) != t)
+      ;
+    wait = r_time() - t0;
+  }
+  lk->locked = 1;
+#elif SPINLOCK == SPIN_MCS
+  // join the end of the line, then wait for the CPU ahead
+  // to clear our node's wait flag. each waiter spins on
+  // its own node, so a release() disturbs only the next.
+  struct mcsnode *n, *pred;
+
+  n = mcsalloc(mycpu());
+  n->next = 0;
+  n->wait = 1;
+  pred = __atomic_exchange_n(&lk->tail, n, __ATOMIC_ACQ_REL);
+  if(pred){
+    contended = 1;
+    t0 = r_time();
+    __atomic_store_n(&pred->next, n, __ATOMIC_RELEASE);
+    while(__atomic_load_n(&n->wait, __ATOMIC_ACQUIRE))
+      ;
+    wait = r_time() - t0;
+  }
+  lk->node = n;
+  lk->locked = 1;
+#else
   // On RISC-V, sync_lock_test_and_set turns into an atomic swap:
   //   a5 = 1
   //   s1 = &lk->locked
   //   amoswap.w.aq a5, a5, (s1)
-  while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
-    ;
+  if(__sync_lock_test_and_set(&lk->locked, 1) != 0){
+    contended = 1;
+    t0 = r_time();
+    while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
+      ;
+    wait = r_time() - t0;
+  }
+#endif
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -40,6 +200,7 @@ acquire(struct spinlock *lk)
 
   // Record info about lock acquisition for holding() and debugging.
   lk->cpu = mycpu();
+  lockcount(lk->cls, contended, wait);
 }
 
 // Release the lock.
@@ -59,6 +220,28 @@ release(struct spinlock *lk)
   // On RISC-V, this emits a fence instruction.
   __sync_synchronize();
 
+#if SPINLOCK == SPIN_TICKET
+  lk->locked = 0;
+  __atomic_store_n(&lk->owner, lk->owner + 1, __ATOMIC_RELEASE);
+#elif SPINLOCK == SPIN_MCS
+  struct mcsnode *n = lk->node, *expected = n;
+
+  lk->locked = 0;
+  lk->node = 0;
+  if(__atomic_load_n(&n->next, __ATOMIC_ACQUIRE) == 0){
+    // no one in line, unless a CPU has just swapped
+    // itself into lk->tail and is about to link to n.
+    if(__atomic_compare_exchange_n(&lk->tail, &expected, 0, 0,
+                                   __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+      goto done;
+    while(__atomic_load_n(&n->next, __ATOMIC_ACQUIRE) == 0)
+      ;
+  }
+  __atomic_store_n(&n->next->wait, 0, __ATOMIC_RELEASE);
+ done:
+  // n may be reused now; the next CPU spins on its own node.
+  mycpu()->mcsbusy &= ~(1 << (n - mycpu()->mcs));
+#else
   // Release the lock, equivalent to lk->locked = 0.
   // This code doesn't use a C assignment, since the C standard
   // implies that an assignment might be implemented with
@@ -67,6 +250,7 @@ release(struct spinlock *lk)
   //   s1 = &lk->locked
   //   amoswap.w zero, zero, (s1)
   __sync_lock_release(&lk->locked);
+#endif
 
   pop_off();
 }
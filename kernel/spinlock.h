@@ -2,8 +2,27 @@
 struct spinlock {
   uint locked;       // Is the lock held?
 
+  // For the queued implementations (see SPINLOCK in param.h):
+  uint next;         // SPIN_TICKET: next ticket to hand out
+  uint owner;        // SPIN_TICKET: ticket now allowed in
+  struct mcsnode *tail; // SPIN_MCS: last CPU in line, or 0
+  struct mcsnode *node; // SPIN_MCS: the holder's place in line
+
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
+  int cls;           // Lock class, for lockstat().
 };
 
+// Spinlock implementations, chosen at build time.
+#define SPIN_TAS     0  // test-and-set: simple, but unfair
+#define SPIN_TICKET  1  // first come, first served
+#define SPIN_MCS     2  // queued, each waiter spinning on its own node
+
+// A CPU's place in line for an MCS lock. Each CPU has
+// a few, for the locks it holds or waits for at once.
+struct mcsnode {
+  struct mcsnode *next;  // next CPU in line
+  int wait;              // 1 until the previous CPU hands over the lock
+};
+#define NMCS 16
@@ -6,10 +6,18 @@
 
 void main();
 void timerinit();
+void ipiinit();
 
 // entry.S needs one stack per CPU.
 __attribute__ ((aligned (16))) char stack0[4096 * NCPU];
 
+// a scratch area per CPU for machine-mode interrupts.
+// [0] saves a register, [1] is the hart's CLINT_MSIP.
+uint64 mscratch0[NCPU][2];
+
+// in kernelvec.S, turns IPIs into supervisor software interrupts.
+void machinevec();
+
 // entry.S jumps here in machine mode on stack0.
 void
 start()
@@ -40,6 +48,9 @@ start()
   // ask for clock interrupts.
   timerinit();
 
+  // and for inter-processor interrupts.
+  ipiinit();
+
   // keep each CPU's hartid in its tp register, for cpuid().
   int id = r_mhartid();
   w_tp(id);
@@ -64,3 +75,17 @@ timerinit()
   // ask for the very first timer interrupt.
   w_stimecmp(r_time() + 1000000);
 }
+
+// arrange for machinevec to receive IPIs, which arrive as
+// machine-mode software interrupts, since those cannot be
+// delegated to supervisor mode.
+void
+ipiinit()
+{
+  int id = r_mhartid();
+
+  mscratch0[id][1] = CLINT_MSIP(id);
+  w_mscratch((uint64)mscratch0[id]);
+  w_mtvec((uint64)machinevec);
+  w_mie(r_mie() | MIE_MSIE);
+}
@@ -5,6 +5,7 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "syscall.h"
+#include "batch.h"
 #include "defs.h"
 
 // Fetch the uint64 at addr from the current process.
@@ -12,7 +13,7 @@ int
 fetchaddr(uint64 addr, uint64 *ip)
 {
   struct proc *p = myproc();
-  if(addr >= p->sz || addr+sizeof(uint64) > p->sz) // both tests needed, in case of overflow
+  if(addr >= p->leader->sz || addr+sizeof(uint64) > p->leader->sz) // both tests needed, in case of overflow
     return -1;
   if(copyin(p->pagetable, (char *)ip, addr, sizeof(*ip)) != 0)
     return -1;
@@ -101,6 +102,21 @@ extern uint64 sys_unlink(void);
 extern uint64 sys_link(void);
 extern uint64 sys_mkdir(void);
 extern uint64 sys_close(void);
+extern uint64 sys_sched_setattr(void);
+extern uint64 sys_sched_getattr(void);
+extern uint64 sys_sched_yield(void);
+extern uint64 sys_clone(void);
+extern uint64 sys_join(void);
+extern uint64 sys_futex(void);
+extern uint64 sys_sched_setaffinity(void);
+extern uint64 sys_sched_getaffinity(void);
+extern uint64 sys_getrusage(void);
+extern uint64 sys_wait4(void);
+extern uint64 sys_schedlat(void);
+extern uint64 sys_batch(void);
+extern uint64 sys_lockstat(void);
+extern uint64 sys_cachestat(void);
+extern uint64 sys_bcachelimit(void);
 
 // An array mapping syscall numbers from syscall.h
 // to the function that handles the system call.
@@ -126,6 +142,21 @@ static uint64 (*syscalls[])(void) = {
 [SYS_link]    sys_link,
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
+[SYS_sched_setattr] sys_sched_setattr,
+[SYS_sched_getattr] sys_sched_getattr,
+[SYS_sched_yield] sys_sched_yield,
+[SYS_clone]   sys_clone,
+[SYS_join]    sys_join,
+[SYS_futex]   sys_futex,
+[SYS_sched_setaffinity] sys_sched_setaffinity,
+[SYS_sched_getaffinity] sys_sched_getaffinity,
+[SYS_getrusage] sys_getrusage,
+[SYS_wait4]   sys_wait4,
+[SYS_schedlat] sys_schedlat,
+[SYS_batch]   sys_batch,
+[SYS_lockstat] sys_lockstat,
+[SYS_cachestat] sys_cachestat,
+[SYS_bcachelimit] sys_bcachelimit,
 };
 
 void
@@ -145,3 +176,63 @@ syscall(void)
     p->trapframe->a0 = -1;
   }
 }
+
+// Make n system calls, described by the array of struct
+// sysent at addr, one after another, writing each one's
+// result to its ret. Calls that do not return to the
+// caller's next instruction, or that replace the
+// caller's memory, are not allowed.
+// Returns the number of calls made, or -1 if addr is bad.
+uint64
+sys_batch(void)
+{
+  struct proc *p = myproc();
+  struct trapframe *tf = p->trapframe;
+  struct sysent e;
+  uint64 addr, a[6];
+  int n, flags, i;
+  int retoff = (char*)&e.ret - (char*)&e;
+
+  argaddr(0, &addr);
+  argint(1, &n);
+  argint(2, &flags);
+
+  // the handlers find their arguments in the trapframe,
+  // where these are.
+  a[0] = tf->a0; a[1] = tf->a1; a[2] = tf->a2;
+  a[3] = tf->a3; a[4] = tf->a4; a[5] = tf->a5;
+
+  for(i = 0; i < n && !killed(p); i++){
+    if(copyin(p->pagetable, (char*)&e, addr + i*sizeof(e), sizeof(e)) < 0){
+      i = -1;
+      break;
+    }
+    if(e.link > 0 && e.link <= i &&
+       copyin(p->pagetable, (char*)&e.args[0],
+              addr + (i-e.link)*sizeof(e) + retoff, sizeof(e.args[0])) < 0){
+      i = -1;
+      break;
+    }
+    tf->a0 = e.args[0]; tf->a1 = e.args[1]; tf->a2 = e.args[2];
+    tf->a3 = e.args[3]; tf->a4 = e.args[4]; tf->a5 = e.args[5];
+    if(e.num > 0 && e.num < NELEM(syscalls) && syscalls[e.num] &&
+       e.num != SYS_fork && e.num != SYS_exec &&
+       e.num != SYS_clone && e.num != SYS_batch)
+      e.ret = syscalls[e.num]();
+    else
+      e.ret = -1;
+    if(copyout(p->pagetable, addr + i*sizeof(e) + retoff,
+               (char*)&e.ret, sizeof(e.ret)) < 0){
+      i = -1;
+      break;
+    }
+    if((flags & BATCH_STOPONERR) && e.ret == -1){
+      i++;
+      break;
+    }
+  }
+
+  tf->a0 = a[0]; tf->a1 = a[1]; tf->a2 = a[2];
+  tf->a3 = a[3]; tf->a4 = a[4]; tf->a5 = a[5];
+  return i;
+}
@@ -20,3 +20,18 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_sched_setattr 22
+#define SYS_sched_getattr 23
+#define SYS_sched_yield 24
+#define SYS_clone  25
+#define SYS_join   26
+#define SYS_futex  27
+#define SYS_sched_setaffinity 28
+#define SYS_sched_getaffinity 29
+#define SYS_getrusage 30
+#define SYS_wait4  31
+#define SYS_schedlat 32
+#define SYS_batch  33
+#define SYS_lockstat 34
+#define SYS_cachestat 35
+#define SYS_bcachelimit 36
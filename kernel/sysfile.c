@@ -15,6 +15,7 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "cachestat.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -25,7 +26,7 @@ argfd(int n, int *pfd, struct file **pf)
   struct file *f;
 
   argint(n, &fd);
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
+  if(fd < 0 || fd >= NOFILE || (f=myproc()->leader->ofile[fd]) == 0)
     return -1;
   if(pfd)
     *pfd = fd;
@@ -40,14 +41,18 @@ static int
 fdalloc(struct file *f)
 {
   int fd;
-  struct proc *p = myproc();
+  struct proc *p = myproc()->leader;
 
+  // the process's threads share p->ofile.
+  acquire(&p->tglock);
   for(fd = 0; fd < NOFILE; fd++){
     if(p->ofile[fd] == 0){
       p->ofile[fd] = f;
+      release(&p->tglock);
       return fd;
     }
   }
+  release(&p->tglock);
   return -1;
 }
 
@@ -99,10 +104,18 @@ sys_close(void)
 {
   int fd;
   struct file *f;
+  struct proc *p = myproc()->leader;
 
   if(argfd(0, &fd, &f) < 0)
     return -1;
-  myproc()->ofile[fd] = 0;
+  // another thread may have closed fd meanwhile.
+  acquire(&p->tglock);
+  if(p->ofile[fd] != f){
+    release(&p->tglock);
+    return -1;
+  }
+  p->ofile[fd] = 0;
+  release(&p->tglock);
   fileclose(f);
   return 0;
 }
@@ -355,6 +368,9 @@ sys_open(void)
   } else {
     f->type = FD_INODE;
     f->off = 0;
+    f->raoff = 0;
+    f->rawin = 0;
+    f->raend = 0;
   }
   f->ip = ip;
   f->readable = !(omode & O_WRONLY);
@@ -410,24 +426,27 @@ uint64
 sys_chdir(void)
 {
   char path[MAXPATH];
-  struct inode *ip;
-  struct proc *p = myproc();
+  struct inode *ip, *old;
+  struct proc *p = myproc()->leader;
   
   begin_op();
   if(argstr(0, path, MAXPATH) < 0 || (ip = namei(path)) == 0){
     end_op();
     return -1;
   }
-  ilock(ip);
+  ilockshared(ip);
   if(ip->type != T_DIR){
     iunlockput(ip);
     end_op();
     return -1;
   }
   iunlock(ip);
-  iput(p->cwd);
-  end_op();
+  acquire(&p->tglock);
+  old = p->cwd;
   p->cwd = ip;
+  release(&p->tglock);
+  iput(old);
+  end_op();
   return 0;
 }
 
@@ -480,7 +499,7 @@ sys_pipe(void)
   uint64 fdarray; // user pointer to array of two integers
   struct file *rf, *wf;
   int fd0, fd1;
-  struct proc *p = myproc();
+  struct proc *p = myproc()->leader;
 
   argaddr(0, &fdarray);
   if(pipealloc(&rf, &wf) < 0)
@@ -503,3 +522,30 @@ sys_pipe(void)
   }
   return 0;
 }
+
+uint64
+sys_cachestat(void)
+{
+  struct cachestat st;
+  uint64 addr; // user pointer to struct cachestat
+
+  argaddr(0, &addr);
+  memset(&st, 0, sizeof(st));
+  bcachestat(&st);
+  icachestat(&st);
+  virtio_disk_stat(&st);
+  if(copyout(myproc()->pagetable, addr, (char*)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
+
+// set the most buffers the buffer cache may hold, if the
+// argument is positive, and return the limit before.
+uint64
+sys_bcachelimit(void)
+{
+  int maxbuf;
+
+  argint(0, &maxbuf);
+  return bcachelimit(maxbuf);
+}
@@ -5,6 +5,8 @@
 #include "memlayout.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "sched.h"
+#include "rusage.h"
 
 uint64
 sys_exit(void)
@@ -18,7 +20,8 @@ sys_exit(void)
 uint64
 sys_getpid(void)
 {
-  return myproc()->pid;
+  // threads share the pid of the process's first thread.
+  return myproc()->leader->pid;
 }
 
 uint64
@@ -35,6 +38,69 @@ sys_wait(void)
   return wait(p);
 }
 
+uint64
+sys_wait4(void)
+{
+  int pid, options;
+  uint64 p, ru;
+
+  argint(0, &pid);
+  argaddr(1, &p);
+  argint(2, &options);
+  argaddr(3, &ru);
+  return wait4(pid, p, options, ru);
+}
+
+uint64
+sys_getrusage(void)
+{
+  int who;
+  uint64 uru; // user pointer to struct rusage
+  struct rusage ru;
+
+  argint(0, &who);
+  argaddr(1, &uru);
+  if(getrusage(who, &ru) < 0)
+    return -1;
+  if(copyout(myproc()->pagetable, uru, (char *)&ru, sizeof(ru)) < 0)
+    return -1;
+  return 0;
+}
+
+uint64
+sys_clone(void)
+{
+  uint64 fn, arg, stack;
+
+  argaddr(0, &fn);
+  argaddr(1, &arg);
+  argaddr(2, &stack);
+  return clone(fn, arg, stack);
+}
+
+uint64
+sys_join(void)
+{
+  int tid;
+  uint64 p;
+
+  argint(0, &tid);
+  argaddr(1, &p);
+  return join(tid, p);
+}
+
+uint64
+sys_futex(void)
+{
+  uint64 uaddr;
+  int op, val;
+
+  argaddr(0, &uaddr);
+  argint(1, &op);
+  argint(2, &val);
+  return futex(uaddr, op, val);
+}
+
 uint64
 sys_sbrk(void)
 {
@@ -42,8 +108,7 @@ sys_sbrk(void)
   int n;
 
   argint(0, &n);
-  addr = myproc()->sz;
-  if(growproc(n) < 0)
+  if((addr = growproc(n)) == -1)
     return -1;
   return addr;
 }
@@ -91,3 +156,96 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+uint64
+sys_sched_setattr(void)
+{
+  int pid;
+  uint64 uattr; // user pointer to struct sched_attr
+  struct sched_attr attr;
+
+  argint(0, &pid);
+  argaddr(1, &uattr);
+  if(copyin(myproc()->pagetable, (char *)&attr, uattr, sizeof(attr)) < 0)
+    return -1;
+  return setschedattr(pid, &attr);
+}
+
+uint64
+sys_sched_getattr(void)
+{
+  int pid;
+  uint64 uattr; // user pointer to struct sched_attr
+  struct sched_attr attr;
+
+  argint(0, &pid);
+  argaddr(1, &uattr);
+  if(getschedattr(pid, &attr) < 0)
+    return -1;
+  if(copyout(myproc()->pagetable, uattr, (char *)&attr, sizeof(attr)) < 0)
+    return -1;
+  return 0;
+}
+
+uint64
+sys_sched_setaffinity(void)
+{
+  int pid;
+  uint64 mask;
+
+  argint(0, &pid);
+  argaddr(1, &mask);
+  return setaffinity(pid, mask);
+}
+
+uint64
+sys_sched_getaffinity(void)
+{
+  int pid;
+  uint64 umask; // user pointer to uint64
+  uint64 mask;
+
+  argint(0, &pid);
+  argaddr(1, &umask);
+  if(getaffinity(pid, &mask) < 0)
+    return -1;
+  if(copyout(myproc()->pagetable, umask, (char *)&mask, sizeof(mask)) < 0)
+    return -1;
+  return 0;
+}
+
+uint64
+sys_schedlat(void)
+{
+  int cpu, flags;
+  uint64 usl; // user pointer to struct schedlat
+  struct schedlat sl;
+
+  argint(0, &cpu);
+  argaddr(1, &usl);
+  argint(2, &flags);
+  if(schedlat(cpu, &sl, flags) < 0)
+    return -1;
+  if(usl != 0 && copyout(myproc()->pagetable, usl, (char *)&sl, sizeof(sl)) < 0)
+    return -1;
+  return 0;
+}
+
+uint64
+sys_lockstat(void)
+{
+  int n, flags;
+  uint64 addr; // user pointer to array of struct lockstat
+
+  argaddr(0, &addr);
+  argint(1, &n);
+  argint(2, &flags);
+  return lockstat(addr, n, flags);
+}
+
+uint64
+sys_sched_yield(void)
+{
+  schedyield();
+  return 0;
+}
@@ -4,10 +4,12 @@
 #include "riscv.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "ushared.h"
 #include "defs.h"
 
 struct spinlock tickslock;
 uint ticks;
+uint64 boottime;  // r_time() when the kernel started
 
 extern char trampoline[], uservec[], userret[];
 
@@ -20,6 +22,7 @@ void
 trapinit(void)
 {
   initlock(&tickslock, "time");
+  boottime = r_time();
 }
 
 // set up to take exceptions and traps while in the kernel.
@@ -27,6 +30,9 @@ void
 trapinithart(void)
 {
   w_stvec((uint64)kernelvec);
+
+  // let user code read the time CSR, for ulib.c's uclock().
+  w_scounteren(r_scounteren() | 2);
 }
 
 //
@@ -46,6 +52,13 @@ usertrap(void)
   w_stvec((uint64)kernelvec);
 
   struct proc *p = myproc();
+
+  // uservec flushed this CPU's TLB; see tlbshootdown().
+  mycpu()->ntrap++;
+
+  uint64 now = r_time();
+  p->u.utime += now - p->tstamp;
+  p->tstamp = now;
   
   // save user program counter.
   p->trapframe->epc = r_sepc();
@@ -67,7 +80,14 @@ usertrap(void)
     syscall();
   } else if((which_dev = devintr()) != 0){
     // ok
+  } else if(r_scause() == 2 && fpenable(p)){
+    // illegal instruction: the first floating-point or
+    // vector instruction since p last got the CPU.
   } else {
+    // there is no demand paging, so a page fault
+    // (instruction, load, store) is always fatal.
+    if(r_scause() == 12 || r_scause() == 13 || r_scause() == 15)
+      p->u.nfault++;
     printf("usertrap(): unexpected scause 0x%lx pid=%d\n", r_scause(), p->pid);
     printf("            sepc=0x%lx stval=0x%lx\n", r_sepc(), r_stval());
     setkilled(p);
@@ -78,7 +98,7 @@ usertrap(void)
 
   // give up the CPU if this is a timer interrupt.
   if(which_dev == 2)
-    yield();
+    preempt();
 
   usertrapret();
 }
@@ -96,6 +116,14 @@ usertrapret(void)
   // we're back in user space, where usertrap() is correct.
   intr_off();
 
+  uint64 now = r_time();
+  p->u.stime += now - p->tstamp;
+  p->tstamp = now;
+
+  // tell the thread what has changed while it was away.
+  p->ushared->ticks = ticks;
+  p->ushared->cpu = cpuid();
+
   // send syscalls, interrupts, and exceptions to uservec in trampoline.S
   uint64 trampoline_uservec = TRAMPOLINE + (uservec - trampoline);
   w_stvec(trampoline_uservec);
@@ -122,11 +150,16 @@ usertrapret(void)
   // tell trampoline.S the user page table to switch to.
   uint64 satp = MAKE_SATP(p->pagetable);
 
+  // userret flushes this CPU's TLB before touching user
+  // memory, so a CPU that starts running p after a
+  // tlbshootdown() began counts as flushed.
+  mycpu()->ntrap++;
+
   // jump to userret in trampoline.S at the top of memory, which 
   // switches to the user page table, restores user registers,
   // and switches to user mode with sret.
   uint64 trampoline_userret = TRAMPOLINE + (userret - trampoline);
-  ((void (*)(uint64))trampoline_userret)(satp);
+  ((void (*)(uint64, uint64))trampoline_userret)(satp, p->tfva);
 }
 
 // interrupts and exceptions from kernel code go here via kernelvec,
@@ -152,33 +185,55 @@ kerneltrap()
 
   // give up the CPU if this is a timer interrupt.
   if(which_dev == 2 && myproc() != 0)
-    yield();
+    preempt();
 
-  // the yield() may have caused some traps to occur,
+  // the preempt() may have caused some traps to occur,
   // so restore trap registers for use by kernelvec.S's sepc instruction.
+  // but leave FS and VS as sched() left them, since they
+  // belong to whichever process's registers the units hold.
   w_sepc(sepc);
-  w_sstatus(sstatus);
+  sstatus &= ~(SSTATUS_FS | SSTATUS_VS);
+  w_sstatus(sstatus | (r_sstatus() & (SSTATUS_FS | SSTATUS_VS)));
 }
 
-void
+// returns 1 if the current process should give up the CPU.
+int
 clockintr()
 {
-  if(cpuid() == 0){
-    acquire(&tickslock);
-    ticks++;
-    wakeup(&ticks);
-    release(&tickslock);
+  struct cpu *c = mycpu();
+  uint64 now = r_time();
+  uint64 next;
+  int yield = 0;
+
+  // the timer also goes off for SCHED_DEADLINE events,
+  // which should not advance ticks.
+  if(now >= c->nexttick){
+    if(cpuid() == 0){
+      acquire(&tickslock);
+      ticks++;
+      wakeup(&ticks);
+      release(&tickslock);
+    }
+    // 1000000 is about a tenth of a second.
+    c->nexttick = now + 1000000;
+    yield = 1;
   }
 
+  if(dl_timer(now, &next))
+    yield = 1;
+  if(next > c->nexttick)
+    next = c->nexttick;
+
   // ask for the next timer interrupt. this also clears
-  // the interrupt request. 1000000 is about a tenth
-  // of a second.
-  w_stimecmp(r_time() + 1000000);
+  // the interrupt request.
+  w_stimecmp(next);
+  return yield;
 }
 
-// check if it's an external interrupt or software interrupt,
+// check if it's an external, timer, or software interrupt,
 // and handle it.
-// returns 2 if timer interrupt,
+// returns 2 if timer interrupt and the current
+// process should give up the CPU,
 // 1 if other device,
 // 0 if not recognized.
 int
@@ -209,8 +264,13 @@ devintr()
     return 1;
   } else if(scause == 0x8000000000000005L){
     // timer interrupt.
-    clockintr();
-    return 2;
+    if(clockintr())
+      return 2;
+    return 1;
+  } else if(scause == 0x8000000000000001L){
+    // software interrupt, from another CPU via machinevec.
+    ipiintr();
+    return 1;
   } else {
     return 0;
   }
@@ -0,0 +1,20 @@
+// The page that the kernel shares read-only with each
+// thread, so that user code can learn these things without
+// a system call. See ugetpid() and friends in ulib.c.
+// Both the kernel and user programs use this header file.
+//
+// The main thread's page is at USHARED (memlayout.h), and
+// each thread finds its own through its tp register.
+
+struct ushared {
+  int pid;             // process ID, as from getpid()
+  int tid;             // this thread's ID, as from clone()
+  int cpu;             // CPU the thread runs on
+  uint ticks;          // clock ticks since boot, as from uptime()
+  uint64 timefreq;     // rate of the time CSR (rdtime), in Hz
+  uint64 boottime;     // time CSR when the kernel started
+};
+
+// cpu and ticks are as of the thread's latest return
+// to user space, which happens at least every tick while
+// it runs, so ticks may lag by up to one.
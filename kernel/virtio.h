@@ -29,6 +29,7 @@
 #define VIRTIO_MMIO_DRIVER_DESC_HIGH	0x094
 #define VIRTIO_MMIO_DEVICE_DESC_LOW	0x0a0 // physical address for used ring, write-only
 #define VIRTIO_MMIO_DEVICE_DESC_HIGH	0x0a4
+#define VIRTIO_MMIO_CONFIG		0x100 // device-specific configuration
 
 // status register bits, from qemu virtio_config.h
 #define VIRTIO_CONFIG_S_ACKNOWLEDGE	1
@@ -37,6 +38,7 @@
 #define VIRTIO_CONFIG_S_FEATURES_OK	8
 
 // device feature bits
+#define VIRTIO_BLK_F_SEG_MAX         2	/* Max segments in a request is in config */
 #define VIRTIO_BLK_F_RO              5	/* Disk is read-only */
 #define VIRTIO_BLK_F_SCSI            7	/* Supports scsi command passthru */
 #define VIRTIO_BLK_F_CONFIG_WCE     11	/* Writeback mode available in config */
@@ -45,9 +47,15 @@
 #define VIRTIO_RING_F_INDIRECT_DESC 28
 #define VIRTIO_RING_F_EVENT_IDX     29
 
-// this many virtio descriptors.
-// must be a power of two.
-#define NUM 8
+// which of the ring features above the disk driver uses.
+// chosen at build time; see VIRTIORING in param.h.
+#define VIRTIO_RING_PLAIN 0 // neither: a ring slot per segment, an interrupt per request
+#define VIRTIO_RING_FAST  1 // INDIRECT_DESC and EVENT_IDX, if the device offers them
+
+// at most this many virtio descriptors; the driver uses as
+// many as the device allows. must be a power of two, and
+// small enough that the descriptor table fits in a page.
+#define NUM 256
 
 // a single descriptor, from the spec.
 struct virtq_desc {
@@ -58,13 +66,14 @@ struct virtq_desc {
 };
 #define VRING_DESC_F_NEXT  1 // chained with another descriptor
 #define VRING_DESC_F_WRITE 2 // device writes (vs read)
+#define VRING_DESC_F_INDIRECT 4 // addr is a table of descriptors
 
 // the (entire) avail ring, from the spec.
 struct virtq_avail {
   uint16 flags; // always zero
   uint16 idx;   // driver will write ring[idx] next
   uint16 ring[NUM]; // descriptor numbers of chain heads
-  uint16 unused;
+  uint16 unused;    // EVENT_IDX: used_event, really at ring[num]
 };
 
 // one entry in the "used" ring, with which the
@@ -78,11 +87,15 @@ struct virtq_used {
   uint16 flags; // always zero
   uint16 idx;   // device increments when it adds a ring[] entry
   struct virtq_used_elem ring[NUM];
+  uint16 unused;    // EVENT_IDX: avail_event, really at ring[num]
 };
 
 // these are specific to virtio block devices, e.g. disks,
 // described in Section 5.2 of the spec.
 
+// offset of seg_max in the block device's configuration.
+#define VIRTIO_BLK_CFG_SEG_MAX 12
+
 #define VIRTIO_BLK_T_IN  0 // read the disk
 #define VIRTIO_BLK_T_OUT 1 // write the disk
 
@@ -15,44 +15,69 @@
 #include "fs.h"
 #include "buf.h"
 #include "virtio.h"
+#include "cachestat.h"
 
 // the address of virtio mmio register r.
 #define R(r) ((volatile uint32 *)(VIRTIO0 + (r)))
 
+// with EVENT_IDX, the driver asks for an interrupt once the
+// device's used->idx passes used_event, and the device asks
+// to be notified once avail->idx passes avail_event. each
+// sits just past the end of its ring.
+#define USED_EVENT  (*(volatile uint16 *)&disk.avail->ring[disk.num])
+#define AVAIL_EVENT (*(volatile uint16 *)&disk.used->ring[disk.num])
+
 static struct disk {
   // a set (not a ring) of DMA descriptors, with which the
   // driver tells the device where to read and write individual
-  // disk operations. there are NUM descriptors.
+  // disk operations. there are num descriptors.
   // most commands consist of a "chain" (a linked list) of a couple of
-  // these descriptors.
+  // these descriptors. with INDIRECT_DESC, each command takes
+  // just one, pointing to its chain in indir[].
   struct virtq_desc *desc;
 
   // a ring in which the driver writes descriptor numbers
   // that the driver would like the device to process.  it only
   // includes the head descriptor of each chain. the ring has
-  // NUM elements.
+  // num elements.
   struct virtq_avail *avail;
 
   // a ring in which the device writes descriptor numbers that
   // the device has finished processing (just the head of each chain).
-  // there are NUM used ring entries.
+  // there are num used ring entries.
   struct virtq_used *used;
 
   // our own book-keeping.
+  int num;         // queue size: NUM, or less if the device says so
+  int maxseg;      // most data descriptors in one request
   char free[NUM];  // is a descriptor free?
-  uint16 used_idx; // we've looked this far in used[2..NUM].
+  int nfree;       // how many are
+  uint16 used_idx; // we've looked this far in used[2..num].
+  int indirect;    // VIRTIO_RING_F_INDIRECT_DESC negotiated?
+  int eventidx;    // VIRTIO_RING_F_EVENT_IDX negotiated?
+  uint16 kicked;   // avail->idx when we last notified the device
+
+  // counts for cachestat().
+  uint64 nreq;
+  uint64 nnotify;
+  uint64 nintr;
 
   // track info about in-flight operations,
   // for use when completion interrupt arrives.
   // indexed by first descriptor index of chain.
   struct {
-    struct buf *b;
+    struct buf *b;   // first buffer; the rest follow b->dnext
     char status;
+    void (*done)(struct buf *);  // if set, called on completion
   } info[NUM];
 
   // disk command headers.
   // one-for-one with descriptors, for convenience.
   struct virtio_blk_req ops[NUM];
+
+  // indirect descriptor tables, likewise one per descriptor,
+  // used when it heads a command.
+  struct virtq_desc indir[NUM][DISKRUN+2];
   
   struct spinlock vdisk_lock;
   
@@ -90,9 +115,13 @@ virtio_disk_init(void)
   features &= ~(1 << VIRTIO_BLK_F_CONFIG_WCE);
   features &= ~(1 << VIRTIO_BLK_F_MQ);
   features &= ~(1 << VIRTIO_F_ANY_LAYOUT);
-  features &= ~(1 << VIRTIO_RING_F_EVENT_IDX);
-  features &= ~(1 << VIRTIO_RING_F_INDIRECT_DESC);
+  if(VIRTIORING == VIRTIO_RING_PLAIN){
+    features &= ~(1 << VIRTIO_RING_F_EVENT_IDX);
+    features &= ~(1 << VIRTIO_RING_F_INDIRECT_DESC);
+  }
   *R(VIRTIO_MMIO_DRIVER_FEATURES) = features;
+  disk.indirect = (features & (1 << VIRTIO_RING_F_INDIRECT_DESC)) != 0;
+  disk.eventidx = (features & (1 << VIRTIO_RING_F_EVENT_IDX)) != 0;
 
   // tell device that feature negotiation is complete.
   status |= VIRTIO_CONFIG_S_FEATURES_OK;
@@ -114,9 +143,21 @@ virtio_disk_init(void)
   uint32 max = *R(VIRTIO_MMIO_QUEUE_NUM_MAX);
   if(max == 0)
     panic("virtio disk has no queue 0");
-  if(max < NUM)
+  // keep as many requests in flight as the device allows.
+  disk.num = NUM;
+  while(disk.num > max)
+    disk.num /= 2;
+  if(disk.num < DISKRUN+2)
     panic("virtio disk max queue too short");
 
+  // requests may carry as many blocks as the device takes.
+  disk.maxseg = DISKRUN;
+  if((features & (1 << VIRTIO_BLK_F_SEG_MAX)) &&
+     *R(VIRTIO_MMIO_CONFIG + VIRTIO_BLK_CFG_SEG_MAX) < disk.maxseg)
+    disk.maxseg = *R(VIRTIO_MMIO_CONFIG + VIRTIO_BLK_CFG_SEG_MAX);
+  if(disk.maxseg < 1)
+    disk.maxseg = 1;
+
   // allocate and zero queue memory.
   disk.desc = kalloc();
   disk.avail = kalloc();
@@ -128,7 +169,7 @@ virtio_disk_init(void)
   memset(disk.used, 0, PGSIZE);
 
   // set queue size.
-  *R(VIRTIO_MMIO_QUEUE_NUM) = NUM;
+  *R(VIRTIO_MMIO_QUEUE_NUM) = disk.num;
 
   // write physical addresses.
   *R(VIRTIO_MMIO_QUEUE_DESC_LOW) = (uint64)disk.desc;
@@ -141,9 +182,10 @@ virtio_disk_init(void)
   // queue is ready.
   *R(VIRTIO_MMIO_QUEUE_READY) = 0x1;
 
-  // all NUM descriptors start out unused.
-  for(int i = 0; i < NUM; i++)
+  // all num descriptors start out unused.
+  for(int i = 0; i < disk.num; i++)
     disk.free[i] = 1;
+  disk.nfree = disk.num;
 
   // tell device we're completely ready.
   status |= VIRTIO_CONFIG_S_DRIVER_OK;
@@ -156,9 +198,10 @@ virtio_disk_init(void)
 static int
 alloc_desc()
 {
-  for(int i = 0; i < NUM; i++){
+  for(int i = 0; i < disk.num; i++){
     if(disk.free[i]){
       disk.free[i] = 0;
+      disk.nfree--;
       return i;
     }
   }
@@ -169,7 +212,7 @@ alloc_desc()
 static void
 free_desc(int i)
 {
-  if(i >= NUM)
+  if(i >= disk.num)
     panic("free_desc 1");
   if(disk.free[i])
     panic("free_desc 2");
@@ -178,6 +221,7 @@ free_desc(int i)
   disk.desc[i].flags = 0;
   disk.desc[i].next = 0;
   disk.free[i] = 1;
+  disk.nfree++;
   wakeup(&disk.free[0]);
 }
 
@@ -196,12 +240,13 @@ free_chain(int i)
   }
 }
 
-// allocate three descriptors (they need not be contiguous).
-// disk transfers always use three descriptors.
+// allocate n descriptors (they need not be contiguous).
 static int
-alloc3_desc(int *idx)
+alloc_descs(int *idx, int n)
 {
-  for(int i = 0; i < 3; i++){
+  if(disk.nfree < n)
+    return -1;
+  for(int i = 0; i < n; i++){
     idx[i] = alloc_desc();
     if(idx[i] < 0){
       for(int j = 0; j < i; j++)
@@ -212,27 +257,83 @@ alloc3_desc(int *idx)
   return 0;
 }
 
-void
-virtio_disk_rw(struct buf *b, int write)
+// Tell the device about new avail ring entries, unless it
+// has said (EVENT_IDX) that it will look at them anyway.
+// Caller must hold disk.vdisk_lock.
+static void
+kick(void)
 {
-  uint64 sector = b->blockno * (BSIZE / 512);
+  uint16 new = disk.avail->idx;
+  uint16 old = disk.kicked;
 
-  acquire(&disk.vdisk_lock);
+  if(new == old)
+    return;
+  disk.kicked = new;
+
+  // make sure the device sees the new entries before we look
+  // at avail_event.
+  __sync_synchronize();
+
+  // notify only if avail_event is in [old, new).
+  if(disk.eventidx && (uint16)(new - AVAIL_EVENT - 1) >= (uint16)(new - old))
+    return;
+  disk.nnotify++;
+  *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+}
+
+// Put the n buffers in bs, which hold consecutive blocks, on
+// the avail ring as one request to read or write them; kick()
+// tells the device. virtio_disk_intr() calls done(b) for each,
+// if done is set, when the disk is done. n <= disk.maxseg.
+// If nowait, returns -1 at once if there are not enough free
+// descriptors, rather than waiting for some. Caller must hold
+// disk.vdisk_lock.
+static int
+virtio_disk_start(struct buf **bs, int n, int write,
+                  void (*done)(struct buf *), int nowait)
+{
+  uint64 sector = bs[0]->blockno * (BSIZE / 512);
+  int i;
+
+  // claim the buffers at once, so that read-ahead leaves them
+  // alone while we wait for descriptors.
+  for(i = 0; i < n; i++)
+    bs[i]->disk = 1;
 
-  // the spec's Section 5.2 says that legacy block operations use
-  // three descriptors: one for type/reserved/sector, one for the
-  // data, one for a 1-byte status result.
+  // the spec's Section 5.2 says that block operations use
+  // a descriptor for type/reserved/sector, then descriptors
+  // for the data, then one for a 1-byte status result.
 
-  // allocate the three descriptors.
-  int idx[3];
+  // allocate the descriptors: just one for the ring if the
+  // chain goes in an indirect table.
+  int idx[DISKRUN+2];
   while(1){
-    if(alloc3_desc(idx) == 0) {
+    if(alloc_descs(idx, disk.indirect ? 1 : n+2) == 0) {
       break;
     }
+    if(nowait){
+      for(i = 0; i < n; i++)
+        bs[i]->disk = 0;
+      return -1;
+    }
+    // the device must hear of what we've queued, or nothing
+    // will free descriptors.
+    kick();
     sleep(&disk.free[0], &disk.vdisk_lock);
   }
 
-  // format the three descriptors.
+  // the chain's descriptors are d[c[0]], d[c[1]], ...
+  struct virtq_desc *d = disk.desc;
+  int *c = idx;
+  int seq[DISKRUN+2];
+  if(disk.indirect){
+    d = disk.indir[idx[0]];
+    for(i = 0; i < n+2; i++)
+      seq[i] = i;
+    c = seq;
+  }
+
+  // format the descriptors.
   // qemu's virtio-blk.c reads them.
 
   struct virtio_blk_req *buf0 = &disk.ops[idx[0]];
@@ -244,57 +345,160 @@ virtio_disk_rw(struct buf *b, int write)
   buf0->reserved = 0;
   buf0->sector = sector;
 
-  disk.desc[idx[0]].addr = (uint64) buf0;
-  disk.desc[idx[0]].len = sizeof(struct virtio_blk_req);
-  disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
-  disk.desc[idx[0]].next = idx[1];
+  d[c[0]].addr = (uint64) buf0;
+  d[c[0]].len = sizeof(struct virtio_blk_req);
+  d[c[0]].flags = VRING_DESC_F_NEXT;
+  d[c[0]].next = c[1];
 
-  disk.desc[idx[1]].addr = (uint64) b->data;
-  disk.desc[idx[1]].len = BSIZE;
-  if(write)
-    disk.desc[idx[1]].flags = 0; // device reads b->data
-  else
-    disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
-  disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
-  disk.desc[idx[1]].next = idx[2];
+  for(i = 1; i <= n; i++){
+    d[c[i]].addr = (uint64) bs[i-1]->data;
+    d[c[i]].len = BSIZE;
+    if(write)
+      d[c[i]].flags = 0; // device reads b->data
+    else
+      d[c[i]].flags = VRING_DESC_F_WRITE; // device writes b->data
+    d[c[i]].flags |= VRING_DESC_F_NEXT;
+    d[c[i]].next = c[i+1];
+    bs[i-1]->dnext = i < n ? bs[i] : 0;
+  }
 
   disk.info[idx[0]].status = 0xff; // device writes 0 on success
-  disk.desc[idx[2]].addr = (uint64) &disk.info[idx[0]].status;
-  disk.desc[idx[2]].len = 1;
-  disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
-  disk.desc[idx[2]].next = 0;
+  d[c[n+1]].addr = (uint64) &disk.info[idx[0]].status;
+  d[c[n+1]].len = 1;
+  d[c[n+1]].flags = VRING_DESC_F_WRITE; // device writes the status
+  d[c[n+1]].next = 0;
+
+  if(disk.indirect){
+    disk.desc[idx[0]].addr = (uint64) d;
+    disk.desc[idx[0]].len = (n+2) * sizeof(struct virtq_desc);
+    disk.desc[idx[0]].flags = VRING_DESC_F_INDIRECT;
+    disk.desc[idx[0]].next = 0;
+  }
 
-  // record struct buf for virtio_disk_intr().
-  b->disk = 1;
-  disk.info[idx[0]].b = b;
+  // record struct bufs for virtio_disk_intr().
+  disk.info[idx[0]].b = bs[0];
+  disk.info[idx[0]].done = done;
 
   // tell the device the first index in our chain of descriptors.
-  disk.avail->ring[disk.avail->idx % NUM] = idx[0];
+  disk.avail->ring[disk.avail->idx % disk.num] = idx[0];
 
   __sync_synchronize();
 
   // tell the device another avail ring entry is available.
-  disk.avail->idx += 1; // not % NUM ...
+  disk.avail->idx += 1; // not % num ...
 
-  __sync_synchronize();
+  disk.nreq++;
+  return 0;
+}
 
-  *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+// how many of the n buffers in bs the device can move as
+// one request: consecutive blocks, at most disk.maxseg.
+static int
+runlen(struct buf **bs, int n)
+{
+  int i;
+
+  for(i = 1; i < n && i < disk.maxseg; i++){
+    if(bs[i]->dev != bs[0]->dev || bs[i]->blockno != bs[0]->blockno + i)
+      break;
+  }
+  return i;
+}
+
+// Start reading (if !valid) or writing the n buffers in bs,
+// and return without waiting for the disk; see
+// virtio_disk_wait(). Runs of consecutive blocks go to the
+// disk as single requests. The caller must hold the buffers
+// locked until the disk is done with them.
+void
+virtio_disk_submit(struct buf **bs, int n, int write)
+{
+  int i, m;
 
-  // Wait for virtio_disk_intr() to say request has finished.
+  acquire(&disk.vdisk_lock);
+
+  // read-ahead may be reading some of them already; start
+  // over after each sleep, in case it took another meanwhile.
+  for(i = 0; i < n; i++){
+    if(bs[i]->disk == 1) {
+      sleep(bs[i], &disk.vdisk_lock);
+      i = -1;
+    }
+  }
+
+  for(i = 0; i < n; i += m){
+    if(!write && bs[i]->valid){
+      m = 1;
+      continue;
+    }
+    for(m = 1; m < n - i && (write || !bs[i+m]->valid); m++)
+      ;
+    m = runlen(bs + i, m);
+    virtio_disk_start(bs + i, m, write, 0, 0);
+  }
+  kick();
+
+  release(&disk.vdisk_lock);
+}
+
+// Wait for virtio_disk_intr() to say the disk is done with b.
+void
+virtio_disk_wait(struct buf *b)
+{
+  acquire(&disk.vdisk_lock);
   while(b->disk == 1) {
     sleep(b, &disk.vdisk_lock);
   }
+  release(&disk.vdisk_lock);
+}
+
+void
+virtio_disk_rw(struct buf *b, int write)
+{
+  virtio_disk_submit(&b, 1, write);
+  virtio_disk_wait(b);
+}
 
-  disk.info[idx[0]].b = 0;
-  free_chain(idx[0]);
+// Start reading the n buffers in bs ahead of need, except
+// those that are valid or being read already, in as few
+// requests as it can. Takes over the caller's references to
+// them, dropping each when its read is done, or at once if
+// it needs none. Sets *nread to the number of reads started.
+// Returns -1 if the device's queue filled up before all
+// could start, else 0.
+int
+virtio_disk_readahead(struct buf **bs, int n, int *nread)
+{
+  int i, m, r = 0;
 
+  *nread = 0;
+  acquire(&disk.vdisk_lock);
+  for(i = 0; i < n; i += m){
+    if(r < 0 || bs[i]->valid || bs[i]->disk){
+      m = 1;
+      breaddone(bs[i]);
+      continue;
+    }
+    for(m = 1; m < n - i && !bs[i+m]->valid && !bs[i+m]->disk; m++)
+      ;
+    m = runlen(bs + i, m);
+    if(virtio_disk_start(bs + i, m, 0, breaddone, 1) < 0){
+      r = -1;
+      m = 0;
+    } else {
+      *nread += m;
+    }
+  }
+  kick();
   release(&disk.vdisk_lock);
+  return r;
 }
 
 void
 virtio_disk_intr()
 {
   acquire(&disk.vdisk_lock);
+  disk.nintr++;
 
   // the device won't raise another interrupt until we tell it
   // we've seen this interrupt, which the following line does.
@@ -309,19 +513,53 @@ virtio_disk_intr()
   // the device increments disk.used->idx when it
   // adds an entry to the used ring.
 
-  while(disk.used_idx != disk.used->idx){
-    __sync_synchronize();
-    int id = disk.used->ring[disk.used_idx % NUM].id;
-
-    if(disk.info[id].status != 0)
-      panic("virtio_disk_intr status");
-
-    struct buf *b = disk.info[id].b;
-    b->disk = 0;   // disk is done with buf
-    wakeup(b);
+  while(1){
+    while(disk.used_idx != disk.used->idx){
+      __sync_synchronize();
+      int id = disk.used->ring[disk.used_idx % disk.num].id;
+
+      if(disk.info[id].status != 0)
+        panic("virtio_disk_intr status");
+
+      void (*done)(struct buf *) = disk.info[id].done;
+      struct buf *b, *nb;
+      for(b = disk.info[id].b; b; b = nb){
+        nb = b->dnext;
+        if(disk.ops[id].type == VIRTIO_BLK_T_IN)
+          b->valid = 1;
+        b->disk = 0;   // disk is done with buf
+        wakeup(b);
+        if(done)
+          done(b);
+      }
+      disk.info[id].b = 0;
+      free_chain(id);
+
+      disk.used_idx += 1;
+    }
+    if(!disk.eventidx)
+      break;
 
-    disk.used_idx += 1;
+    // with EVENT_IDX, completions that come while we work
+    // here raise no interrupt. ask for one at the next
+    // completion, then look once more, in case it came
+    // before the device saw used_event.
+    USED_EVENT = disk.used_idx;
+    __sync_synchronize();
+    if(disk.used_idx == disk.used->idx)
+      break;
   }
 
   release(&disk.vdisk_lock);
 }
+
+// Fill in the disk's counts in *st.
+void
+virtio_disk_stat(struct cachestat *st)
+{
+  acquire(&disk.vdisk_lock);
+  st->dreq = disk.nreq;
+  st->dnotify = disk.nnotify;
+  st->dintr = disk.nintr;
+  release(&disk.vdisk_lock);
+}
@@ -0,0 +1,135 @@
+// Buffer cache scalability benchmark.
+//
+// usage: bcachebench [seconds [kbytes]]
+//
+// For 1, 2, 4 and 8 processes, each process reads its own
+// file of kbytes (default 2) from start to end over and over,
+// so that every read finds its blocks in the buffer cache
+// but the processes share no inode. bcachebench reports KB
+// read per second in all, which should grow with the number
+// of processes (up to the number of CPUs) when bget() and
+// brelse() do not all wait for one lock.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define MAXPROCS 8
+
+char buf[1024];
+int secs = 2;
+
+void
+name(char *s, int i)
+{
+  strcpy(s, "bcbench0");
+  s[7] = '0' + i;
+}
+
+// read file until the deadline, and return bytes read.
+uint64
+work(char *file, uint64 end)
+{
+  uint64 n = 0;
+  int fd, r;
+
+  if((fd = open(file, O_RDONLY)) < 0){
+    printf("bcachebench: open %s failed\n", file);
+    exit(1);
+  }
+  while(uclock() < end){
+    while((r = read(fd, buf, sizeof(buf))) > 0)
+      n += r;
+    close(fd);
+    fd = open(file, O_RDONLY);
+  }
+  close(fd);
+  return n;
+}
+
+void
+run(int nprocs)
+{
+  uint64 n, total, start;
+  char file[16];
+  int fds[2];
+  int i;
+
+  if(pipe(fds) < 0){
+    printf("bcachebench: pipe failed\n");
+    exit(1);
+  }
+  // start together, a little after all have been forked.
+  start = uclock() + 100000;
+  for(i = 0; i < nprocs; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("bcachebench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      close(fds[0]);
+      name(file, i);
+      while(uclock() < start)
+        ;
+      n = work(file, start + secs * 1000000UL);
+      write(fds[1], &n, sizeof(n));
+      exit(0);
+    }
+  }
+  close(fds[1]);
+
+  total = 0;
+  for(i = 0; i < nprocs; i++){
+    if(read(fds[0], &n, sizeof(n)) != sizeof(n)){
+      printf("bcachebench: read failed\n");
+      exit(1);
+    }
+    total += n;
+  }
+  close(fds[0]);
+  for(i = 0; i < nprocs; i++)
+    wait(0);
+
+  printf("%d procs: %lu KB/s\n", nprocs, total / 1024 / secs);
+}
+
+int
+main(int argc, char *argv[])
+{
+  char file[16];
+  int fd, i, j, kb = 2, n;
+
+  if(argc > 1)
+    secs = atoi(argv[1]);
+  if(argc > 2)
+    kb = atoi(argv[2]);
+  if(secs < 1)
+    secs = 1;
+
+  memset(buf, 'x', sizeof(buf));
+  for(i = 0; i < MAXPROCS; i++){
+    name(file, i);
+    if((fd = open(file, O_CREATE|O_TRUNC|O_WRONLY)) < 0){
+      printf("bcachebench: create %s failed\n", file);
+      exit(1);
+    }
+    for(j = 0; j < kb; j++){
+      if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+        printf("bcachebench: write failed\n");
+        exit(1);
+      }
+    }
+    close(fd);
+  }
+
+  for(n = 1; n <= MAXPROCS; n *= 2)
+    run(n);
+
+  for(i = 0; i < MAXPROCS; i++){
+    name(file, i);
+    unlink(file);
+  }
+  exit(0);
+}
@@ -0,0 +1,77 @@
+// Print buffer cache, inode table and disk statistics.
+//
+// usage: cachestat [-m maxbuf] [seconds [count]]
+//
+// Prints the sizes of the caches and the counts so far, then,
+// if seconds is given, a line of counts every so many seconds
+// (count times, or until killed). With -m, first limits the
+// buffer cache to maxbuf buffers.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/cachestat.h"
+#include "user/user.h"
+
+// percentage of hit in hit+miss.
+int
+ratio(uint64 hit, uint64 miss)
+{
+  return hit + miss ? hit * 100 / (hit + miss) : 0;
+}
+
+void
+line(struct cachestat *a, struct cachestat *b)
+{
+  printf("%lu %lu %d%% %lu %lu %lu %lu %lu   %lu %lu %d%% %lu   %lu %lu %lu\n",
+         b->bhit - a->bhit, b->bmiss - a->bmiss,
+         ratio(b->bhit - a->bhit, b->bmiss - a->bmiss),
+         b->brecycle - a->brecycle, b->bghost - a->bghost,
+         b->bdiskread - a->bdiskread, b->bdiskwrite - a->bdiskwrite,
+         b->breadahead - a->breadahead,
+         b->ihit - a->ihit, b->imiss - a->imiss,
+         ratio(b->ihit - a->ihit, b->imiss - a->imiss),
+         b->irecycle - a->irecycle,
+         b->dreq - a->dreq, b->dnotify - a->dnotify, b->dintr - a->dintr);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct cachestat zero, prev, st;
+  int i = 1, maxbuf = 0, secs = 0, count = -1;
+
+  if(argc > 2 && strcmp(argv[1], "-m") == 0){
+    maxbuf = atoi(argv[2]);
+    i = 3;
+  }
+  if(argc > i)
+    secs = atoi(argv[i]);
+  if(argc > i + 1)
+    count = atoi(argv[i + 1]);
+
+  if(maxbuf > 0)
+    bcachelimit(maxbuf);
+  if(cachestat(&st) < 0){
+    fprintf(2, "cachestat: failed\n");
+    exit(1);
+  }
+  printf("buffers: %lu of at most %lu, %lu pinned, %lu hot\n",
+         st.nbuf, st.maxbuf, st.npinned, st.nhot);
+  printf("inodes: %lu of %lu in use\n", st.iused, st.ninode);
+  printf("bhit bmiss ratio recycle ghost dread dwrite ahead   ihit imiss ratio recycle   req notify intr\n");
+  memset(&zero, 0, sizeof(zero));
+  line(&zero, &st);
+
+  while(secs > 0 && count != 0){
+    prev = st;
+    sleep(secs * 10);
+    if(cachestat(&st) < 0){
+      fprintf(2, "cachestat: failed\n");
+      exit(1);
+    }
+    line(&prev, &st);
+    if(count > 0)
+      count--;
+  }
+  exit(0);
+}
@@ -0,0 +1,148 @@
+// Disk read throughput benchmark.
+//
+// usage: diskbench [seconds [kbytes]]
+//
+// For 1, 2, 4 and 8 processes, each process reads its own
+// file of kbytes (default 400) from start to end over and
+// over, with the buffer cache limited to far fewer blocks
+// than the files hold, so that nearly every block comes from
+// the disk. diskbench reports KB read per second in all,
+// which should grow with the number of processes while the
+// disk can keep more of their requests in flight at once.
+// It also reports disk requests per second, and interrupts
+// and notifications of the disk per hundred requests; to see
+// what indirect descriptors and event indexes save, compare
+// kernels built with RING=PLAIN and RING=FAST.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/cachestat.h"
+#include "user/user.h"
+
+#define MAXPROCS 8
+#define CACHEBUF 100   // buffer cache limit while reading
+
+char buf[1024];
+int secs = 2;
+
+void
+name(char *s, int i)
+{
+  strcpy(s, "dbench0");
+  s[6] = '0' + i;
+}
+
+// read file until the deadline, and return bytes read.
+uint64
+work(char *file, uint64 end)
+{
+  uint64 n = 0;
+  int fd, r;
+
+  while(uclock() < end){
+    if((fd = open(file, O_RDONLY)) < 0){
+      printf("diskbench: open %s failed\n", file);
+      exit(1);
+    }
+    while((r = read(fd, buf, sizeof(buf))) > 0)
+      n += r;
+    close(fd);
+  }
+  return n;
+}
+
+void
+run(int nprocs)
+{
+  struct cachestat st0, st1;
+  uint64 n, total, start, req;
+  char file[16];
+  int fds[2];
+  int i;
+
+  if(pipe(fds) < 0){
+    printf("diskbench: pipe failed\n");
+    exit(1);
+  }
+  cachestat(&st0);
+  // start together, a little after all have been forked.
+  start = uclock() + 100000;
+  for(i = 0; i < nprocs; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("diskbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      close(fds[0]);
+      name(file, i);
+      while(uclock() < start)
+        ;
+      n = work(file, start + secs * 1000000UL);
+      write(fds[1], &n, sizeof(n));
+      exit(0);
+    }
+  }
+  close(fds[1]);
+
+  total = 0;
+  for(i = 0; i < nprocs; i++){
+    if(read(fds[0], &n, sizeof(n)) != sizeof(n)){
+      printf("diskbench: read failed\n");
+      exit(1);
+    }
+    total += n;
+  }
+  close(fds[0]);
+  for(i = 0; i < nprocs; i++)
+    wait(0);
+  cachestat(&st1);
+
+  req = st1.dreq - st0.dreq;
+  printf("%d procs: %lu KB/s, %lu req/s, %lu intr and %lu notify per 100 req\n",
+         nprocs, total / 1024 / secs, req / secs,
+         req ? (st1.dintr - st0.dintr) * 100 / req : 0,
+         req ? (st1.dnotify - st0.dnotify) * 100 / req : 0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  char file[16];
+  int fd, i, j, kb = 400, n, old;
+
+  if(argc > 1)
+    secs = atoi(argv[1]);
+  if(argc > 2)
+    kb = atoi(argv[2]);
+  if(secs < 1)
+    secs = 1;
+
+  memset(buf, 'x', sizeof(buf));
+  for(i = 0; i < MAXPROCS; i++){
+    name(file, i);
+    if((fd = open(file, O_CREATE|O_TRUNC|O_WRONLY)) < 0){
+      printf("diskbench: create %s failed\n", file);
+      exit(1);
+    }
+    for(j = 0; j < kb; j++){
+      if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+        printf("diskbench: write failed\n");
+        exit(1);
+      }
+    }
+    close(fd);
+  }
+
+  old = bcachelimit(CACHEBUF);
+  for(n = 1; n <= MAXPROCS; n *= 2)
+    run(n);
+  bcachelimit(old);
+
+  for(i = 0; i < MAXPROCS; i++){
+    name(file, i);
+    unlink(file);
+  }
+  exit(0);
+}
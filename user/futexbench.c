@@ -0,0 +1,126 @@
+// Contention benchmark for the futex-based mutex in ulib.c.
+//
+// usage: futexbench [iterations]
+//
+// For 1, 2, 4 and 8 threads, each thread takes and releases
+// a shared lock iterations times, incrementing a counter while
+// holding it. The lock is first a plain spinlock, then a
+// mutex, which sleeps in futex() instead of spinning. Finally
+// two threads pass a token back and forth with a condition
+// variable.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+#define MAXTHREADS 8
+
+int iters = 20000;
+int usemutex;
+volatile int spinlock;
+struct mutex mutex;
+struct cond cond;
+volatile int counter;
+volatile int turn;
+
+void
+spin_lock(void)
+{
+  while(__sync_lock_test_and_set(&spinlock, 1) != 0)
+    ;
+}
+
+void
+spin_unlock(void)
+{
+  __sync_lock_release(&spinlock);
+}
+
+void
+worker(void *arg)
+{
+  for(int i = 0; i < iters; i++){
+    if(usemutex)
+      mutex_lock(&mutex);
+    else
+      spin_lock();
+    counter++;
+    if(usemutex)
+      mutex_unlock(&mutex);
+    else
+      spin_unlock();
+  }
+  exit(0);
+}
+
+// thread me waits for its turn, then hands it to the other.
+void
+pingpong(void *arg)
+{
+  int me = (int)(uint64)arg;
+
+  for(int i = 0; i < iters; i++){
+    mutex_lock(&mutex);
+    while(turn != me)
+      cond_wait(&cond, &mutex);
+    turn = !me;
+    cond_signal(&cond);
+    mutex_unlock(&mutex);
+  }
+  exit(0);
+}
+
+// run n threads of fn, and return the elapsed ticks.
+int
+run(int n, void (*fn)(void*))
+{
+  char *stacks[MAXTHREADS];
+  int tids[MAXTHREADS];
+  int i, t0;
+
+  for(i = 0; i < n; i++)
+    stacks[i] = malloc(PGSIZE);
+  t0 = uptime();
+  for(i = 0; i < n; i++){
+    if((tids[i] = clone(fn, (void*)(uint64)i, stacks[i] + PGSIZE)) < 0){
+      printf("futexbench: clone failed\n");
+      exit(1);
+    }
+  }
+  for(i = 0; i < n; i++)
+    join(tids[i], 0);
+  t0 = uptime() - t0;
+  for(i = 0; i < n; i++)
+    free(stacks[i]);
+  return t0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n, t;
+
+  if(argc > 1)
+    iters = atoi(argv[1]);
+
+  mutex_init(&mutex);
+  cond_init(&cond);
+  for(n = 1; n <= MAXTHREADS; n *= 2){
+    for(usemutex = 0; usemutex <= 1; usemutex++){
+      counter = 0;
+      t = run(n, worker);
+      printf("futexbench: %d threads, %s: %d ticks", n,
+             usemutex ? "mutex" : "spinlock", t);
+      if(counter != n * iters)
+        printf(" (counter %d, expected %d)", counter, n * iters);
+      printf("\n");
+    }
+  }
+
+  turn = 0;
+  t = run(2, pingpong);
+  printf("futexbench: %d condvar round trips: %d ticks\n", iters, t);
+
+  exit(0);
+}
@@ -0,0 +1,118 @@
+// Measure how long processes wait to run after a wakeup.
+//
+// usage: latbench [nhogs [rounds]]
+//
+// latbench starts nhogs CPU-bound processes, then has two
+// processes pass a byte back and forth through pipes rounds
+// times, so that each one sleeps in read() and is woken by
+// the other's write(). It then reports the median and 99th
+// percentile of the kernel's scheduling latency histograms
+// (see schedlat()), for wakeups and for preempted processes.
+
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/sched.h"
+#include "user/user.h"
+
+#define MAXHOGS 64
+
+// Return the upper bound, in microseconds, of the histogram
+// bucket that holds the pct'th percentile of h.
+uint64
+percentile(uint64 *h, int pct)
+{
+  uint64 n, sum;
+  int i;
+
+  n = 0;
+  for(i = 0; i < NLATBUCKET; i++)
+    n += h[i];
+  sum = 0;
+  for(i = 0; i < NLATBUCKET; i++){
+    sum += h[i];
+    if(sum * 100 >= n * pct)
+      break;
+  }
+  return 2UL << i;
+}
+
+uint64
+total(uint64 *h)
+{
+  uint64 n = 0;
+
+  for(int i = 0; i < NLATBUCKET; i++)
+    n += h[i];
+  return n;
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct schedlat sl;
+  int nhogs = NCPU, rounds = 1000;
+  int hogs[MAXHOGS];
+  int ping[2], pong[2];
+  int i, pid;
+  char c;
+
+  if(argc > 1)
+    nhogs = atoi(argv[1]);
+  if(argc > 2)
+    rounds = atoi(argv[2]);
+  if(nhogs > MAXHOGS)
+    nhogs = MAXHOGS;
+
+  for(i = 0; i < nhogs; i++){
+    hogs[i] = fork();
+    if(hogs[i] < 0){
+      printf("latbench: fork failed\n");
+      nhogs = i;
+      break;
+    }
+    if(hogs[i] == 0)
+      for(;;)
+        ;
+  }
+
+  if(pipe(ping) < 0 || pipe(pong) < 0){
+    printf("latbench: pipe failed\n");
+    exit(1);
+  }
+  schedlat(-1, 0, SCHEDLAT_RESET);
+  pid = fork();
+  if(pid < 0){
+    printf("latbench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    for(i = 0; i < rounds; i++){
+      if(read(ping[0], &c, 1) != 1)
+        exit(1);
+      write(pong[1], &c, 1);
+    }
+    exit(0);
+  }
+  for(i = 0; i < rounds; i++){
+    write(ping[1], "x", 1);
+    if(read(pong[0], &c, 1) != 1){
+      printf("latbench: read failed\n");
+      break;
+    }
+  }
+  wait(0);
+  schedlat(-1, &sl, 0);
+
+  for(i = 0; i < nhogs; i++){
+    kill(hogs[i]);
+    wait(0);
+  }
+
+  printf("latbench: %d hogs, %d rounds\n", nhogs, rounds);
+  printf("wakeup:  %lu runs, p50 < %lu us, p99 < %lu us\n", total(sl.wakeup),
+         percentile(sl.wakeup, 50), percentile(sl.wakeup, 99));
+  printf("preempt: %lu runs, p50 < %lu us, p99 < %lu us\n", total(sl.preempt),
+         percentile(sl.preempt, 50), percentile(sl.preempt, 99));
+  exit(0);
+}
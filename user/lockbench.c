@@ -0,0 +1,112 @@
+// Kernel spinlock scalability benchmark.
+//
+// usage: lockbench [seconds]
+//
+// For 1, 2, 4 and 8 processes, each process makes system
+// calls that take one contended kernel lock for a while:
+// uptime(), which takes tickslock, then sbrk() up and down
+// by a page, which takes kmem.lock in kalloc() and kfree().
+// lockbench reports calls per second in all, and the fewest
+// and most made by any one process, which shows how fair
+// the lock is.
+//
+// To compare the spinlock implementations, run it under
+// each, with different numbers of CPUs, e.g.
+//   $ make clean; make qemu LOCK=TICKET CPUS=4
+// for LOCK=TAS, TICKET, MCS and CPUS=1..8.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define MAXPROCS 8
+
+int secs = 2;
+
+// make calls of the given kind until the deadline, and
+// return how many.
+uint64
+work(int kind, uint64 end)
+{
+  uint64 n = 0;
+
+  while(uclock() < end){
+    if(kind == 0){
+      uptime();
+    } else {
+      sbrk(4096);
+      sbrk(-4096);
+    }
+    n++;
+  }
+  return n;
+}
+
+void
+run(int kind, int nprocs)
+{
+  uint64 n, total, min, max, start;
+  int fds[2];
+  int i;
+
+  if(pipe(fds) < 0){
+    printf("lockbench: pipe failed\n");
+    exit(1);
+  }
+  // start together, a little after all have been forked.
+  start = uclock() + 100000;
+  for(i = 0; i < nprocs; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("lockbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      close(fds[0]);
+      while(uclock() < start)
+        ;
+      n = work(kind, start + secs * 1000000UL);
+      write(fds[1], &n, sizeof(n));
+      exit(0);
+    }
+  }
+  close(fds[1]);
+
+  total = 0;
+  min = ~0UL;
+  max = 0;
+  for(i = 0; i < nprocs; i++){
+    if(read(fds[0], &n, sizeof(n)) != sizeof(n)){
+      printf("lockbench: read failed\n");
+      exit(1);
+    }
+    total += n;
+    if(n < min)
+      min = n;
+    if(n > max)
+      max = n;
+  }
+  close(fds[0]);
+  for(i = 0; i < nprocs; i++)
+    wait(0);
+
+  printf("%s %d procs: %lu calls/s, per proc min %lu max %lu\n",
+         kind == 0 ? "tickslock" : "kmem.lock", nprocs,
+         total / secs, min, max);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int kind, n;
+
+  if(argc > 1)
+    secs = atoi(argv[1]);
+  if(secs < 1)
+    secs = 1;
+
+  for(kind = 0; kind < 2; kind++)
+    for(n = 1; n <= MAXPROCS; n *= 2)
+      run(kind, n);
+  exit(0);
+}
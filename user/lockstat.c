@@ -0,0 +1,63 @@
+// Print the most contended kernel lock classes.
+//
+// usage: lockstat [-r] [n]
+//
+// Prints the n (default 10) lock classes that were contended
+// most often, with -r also resetting the counts.
+
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/lockstat.h"
+#include "user/user.h"
+
+struct lockstat ls[NLOCKCLASS];
+
+// does a belong before b?
+int
+before(struct lockstat *a, struct lockstat *b)
+{
+  if(a->ncontended != b->ncontended)
+    return a->ncontended > b->ncontended;
+  return a->wait > b->wait;
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct lockstat t;
+  int i, j, n, top = 10, flags = 0;
+
+  for(i = 1; i < argc; i++){
+    if(strcmp(argv[i], "-r") == 0)
+      flags = LOCKSTAT_RESET;
+    else
+      top = atoi(argv[i]);
+  }
+
+  n = lockstat(ls, NLOCKCLASS, flags);
+  if(n < 0){
+    fprintf(2, "lockstat: failed\n");
+    exit(1);
+  }
+
+  // insertion sort; there are few classes.
+  for(i = 1; i < n; i++){
+    t = ls[i];
+    for(j = i; j > 0 && before(&t, &ls[j-1]); j--)
+      ls[j] = ls[j-1];
+    ls[j] = t;
+  }
+
+  printf("name             kind   acquired  contended  wait (us)\n");
+  for(i = 0; i < n && i < top; i++){
+    if(ls[i].nacquire == 0)
+      break;
+    printf("%s", ls[i].name);
+    for(j = strlen(ls[i].name); j < 17; j++)
+      printf(" ");
+    printf("%s  %lu  %lu  %lu\n", ls[i].sleep ? "sleep" : "spin ",
+           ls[i].nacquire, ls[i].ncontended, ls[i].wait);
+  }
+  exit(0);
+}
@@ -0,0 +1,79 @@
+// Measure how many SCHED_DEADLINE jobs miss their deadline
+// while other processes keep the CPUs busy.
+//
+// usage: rtbench [nhogs [njobs]]
+//
+// rtbench starts nhogs CPU-bound SCHED_NORMAL processes, then
+// runs njobs periodic jobs for each of a few periods. For load
+// that also exercises the file system and fork/exec, run
+//   $ grind &
+//   $ rtbench
+// and kill grind afterwards.
+
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/sched.h"
+#include "user/user.h"
+
+#define MAXHOGS 64
+
+int periods[] = { 2000, 10000, 50000 };  // microseconds
+
+int
+main(int argc, char *argv[])
+{
+  struct sched_attr attr;
+  int nhogs = NCPU, njobs = 100;
+  int hogs[MAXHOGS];
+  int i, j, k;
+  volatile int x;
+
+  if(argc > 1)
+    nhogs = atoi(argv[1]);
+  if(argc > 2)
+    njobs = atoi(argv[2]);
+  if(nhogs > MAXHOGS)
+    nhogs = MAXHOGS;
+
+  for(i = 0; i < nhogs; i++){
+    hogs[i] = fork();
+    if(hogs[i] < 0){
+      printf("rtbench: fork failed\n");
+      nhogs = i;
+      break;
+    }
+    if(hogs[i] == 0)
+      for(;;)
+        ;
+  }
+
+  for(i = 0; i < sizeof(periods)/sizeof(periods[0]); i++){
+    sched_getattr(0, &attr);
+    attr.policy = SCHED_DEADLINE;
+    attr.period = attr.deadline = periods[i];
+    attr.runtime = periods[i] / 4;
+    if(sched_setattr(0, &attr) < 0){
+      printf("rtbench: period %d us: not admitted\n", periods[i]);
+      continue;
+    }
+    for(j = 0; j < njobs; j++){
+      // a little work, well within the runtime.
+      for(k = 0; k < 1000; k++)
+        x = k;
+      sched_yield();
+    }
+    sched_getattr(0, &attr);
+    printf("rtbench: period %d us, %d hogs: %d of %d jobs missed\n",
+           periods[i], nhogs, attr.misses, njobs);
+  }
+  (void)x;
+
+  attr.policy = SCHED_NORMAL;
+  sched_setattr(0, &attr);
+  for(i = 0; i < nhogs; i++){
+    kill(hogs[i]);
+    wait(0);
+  }
+  exit(0);
+}
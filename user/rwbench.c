@@ -0,0 +1,140 @@
+// Shared inode lock benchmark.
+//
+// usage: rwbench [seconds [kbytes]]
+//
+// For 1, 2, 4 and 8 processes, each process reads one file
+// of kbytes (default 20) from start to end over and over,
+// then each process execs one program (rwbench itself) over
+// and over. rwbench reports bytes read and execs per
+// second in all. Processes that read the same inode only
+// lock it shared, so with more CPUs the rates should grow.
+// The default file fits in the buffer cache, so that the
+// disk does not hide the locking.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define MAXPROCS 8
+
+char *file = "rwbench.tmp";
+char buf[4096];
+int secs = 2;
+
+// read the file or exec rwbench until the deadline, and
+// return bytes read or programs run.
+uint64
+work(int kind, uint64 end)
+{
+  uint64 n = 0;
+  char *argv[] = { "rwbench", "-x", 0 };
+  int fd, r, pid;
+
+  while(uclock() < end){
+    if(kind == 0){
+      if((fd = open(file, O_RDONLY)) < 0){
+        printf("rwbench: open %s failed\n", file);
+        exit(1);
+      }
+      while((r = read(fd, buf, sizeof(buf))) > 0)
+        n += r;
+      close(fd);
+    } else {
+      if((pid = fork()) < 0){
+        printf("rwbench: fork failed\n");
+        exit(1);
+      }
+      if(pid == 0){
+        exec(argv[0], argv);
+        printf("rwbench: exec failed\n");
+        exit(1);
+      }
+      wait(0);
+      n++;
+    }
+  }
+  return n;
+}
+
+void
+run(int kind, int nprocs)
+{
+  uint64 n, total, start;
+  int fds[2];
+  int i;
+
+  if(pipe(fds) < 0){
+    printf("rwbench: pipe failed\n");
+    exit(1);
+  }
+  // start together, a little after all have been forked.
+  start = uclock() + 100000;
+  for(i = 0; i < nprocs; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("rwbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      close(fds[0]);
+      while(uclock() < start)
+        ;
+      n = work(kind, start + secs * 1000000UL);
+      write(fds[1], &n, sizeof(n));
+      exit(0);
+    }
+  }
+  close(fds[1]);
+
+  total = 0;
+  for(i = 0; i < nprocs; i++){
+    if(read(fds[0], &n, sizeof(n)) != sizeof(n)){
+      printf("rwbench: read failed\n");
+      exit(1);
+    }
+    total += n;
+  }
+  close(fds[0]);
+  for(i = 0; i < nprocs; i++)
+    wait(0);
+
+  if(kind == 0)
+    printf("read %d procs: %lu KB/s\n", nprocs, total / 1024 / secs);
+  else
+    printf("exec %d procs: %lu execs/s\n", nprocs, total / secs);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fd, i, kb = 20, kind, n;
+
+  if(argc > 1 && strcmp(argv[1], "-x") == 0)
+    exit(0);
+  if(argc > 1)
+    secs = atoi(argv[1]);
+  if(argc > 2)
+    kb = atoi(argv[2]);
+  if(secs < 1)
+    secs = 1;
+
+  if((fd = open(file, O_CREATE|O_TRUNC|O_WRONLY)) < 0){
+    printf("rwbench: create %s failed\n", file);
+    exit(1);
+  }
+  memset(buf, 'x', 1024);
+  for(i = 0; i < kb; i++){
+    if(write(fd, buf, 1024) != 1024){
+      printf("rwbench: write failed\n");
+      exit(1);
+    }
+  }
+  close(fd);
+
+  for(kind = 0; kind < 2; kind++)
+    for(n = 1; n <= MAXPROCS; n *= 2)
+      run(kind, n);
+  unlink(file);
+  exit(0);
+}
@@ -0,0 +1,146 @@
+// Buffer cache scan resistance benchmark.
+//
+// usage: scanbench [nbuf [seconds]]
+//
+// Limits the buffer cache to nbuf buffers (default 200), then
+// measures file creates and deletes per second, and the
+// buffer cache hit ratio, first alone and then while another
+// process reads files much bigger than the cache over and
+// over. The creates and deletes use the same few bitmap,
+// inode and directory blocks again and again, which the
+// scan should not push out of the cache. To compare the
+// replacement policies, run it under each, e.g.
+//   $ make clean; make qemu BCACHE=LRU
+// for BCACHE=LRU and 2Q.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/cachestat.h"
+#include "user/user.h"
+
+#define NSCAN 4          // files to scan
+#define SCANSIZE 200     // kbytes in each
+
+char buf[1024];
+int secs = 2;
+
+void
+name(char *s, char *prefix, int i)
+{
+  strcpy(s, prefix);
+  s[strlen(prefix)] = '0' + i;
+  s[strlen(prefix)+1] = 0;
+}
+
+// read all the scan files, over and over.
+void
+scan(void)
+{
+  char file[16];
+  int fd, i;
+
+  for(;;){
+    for(i = 0; i < NSCAN; i++){
+      name(file, "sbscan", i);
+      if((fd = open(file, O_RDONLY)) < 0){
+        printf("scanbench: open %s failed\n", file);
+        exit(1);
+      }
+      while(read(fd, buf, sizeof(buf)) > 0)
+        ;
+      close(fd);
+    }
+  }
+}
+
+// create and delete files for secs, and report.
+void
+createdelete(char *what)
+{
+  struct cachestat st0, st1;
+  uint64 n, end, hit, miss;
+  char file[16];
+  int fd, i;
+
+  cachestat(&st0);
+  end = uclock() + secs * 1000000UL;
+  for(n = 0; uclock() < end; n++){
+    for(i = 0; i < 8; i++){
+      name(file, "sbdir/f", i);
+      if((fd = open(file, O_CREATE|O_RDWR)) < 0){
+        printf("scanbench: create %s failed\n", file);
+        exit(1);
+      }
+      write(fd, buf, 16);
+      close(fd);
+    }
+    for(i = 0; i < 8; i++){
+      name(file, "sbdir/f", i);
+      unlink(file);
+    }
+  }
+  cachestat(&st1);
+
+  hit = st1.bhit - st0.bhit;
+  miss = st1.bmiss - st0.bmiss;
+  printf("%s: %lu creates+deletes/s, hit ratio %lu%%, %lu hot buffers\n",
+         what, n * 8 / secs, hit + miss ? hit * 100 / (hit + miss) : 0,
+         st1.nhot);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct cachestat st;
+  char file[16];
+  int fd, i, j, pid, nbuf = 200, old;
+
+  if(argc > 1)
+    nbuf = atoi(argv[1]);
+  if(argc > 2)
+    secs = atoi(argv[2]);
+  if(secs < 1)
+    secs = 1;
+
+  memset(buf, 'x', sizeof(buf));
+  for(i = 0; i < NSCAN; i++){
+    name(file, "sbscan", i);
+    if((fd = open(file, O_CREATE|O_TRUNC|O_WRONLY)) < 0){
+      printf("scanbench: create %s failed\n", file);
+      exit(1);
+    }
+    for(j = 0; j < SCANSIZE; j++){
+      if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+        printf("scanbench: write failed\n");
+        exit(1);
+      }
+    }
+    close(fd);
+  }
+  mkdir("sbdir");
+
+  old = bcachelimit(nbuf);
+  cachestat(&st);
+  printf("scanbench: %lu buffers\n", st.maxbuf);
+
+  createdelete("alone");
+
+  if((pid = fork()) < 0){
+    printf("scanbench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0)
+    scan();
+  createdelete("with scan");
+  kill(pid);
+  wait(0);
+
+  bcachelimit(old);
+  for(i = 0; i < NSCAN; i++){
+    name(file, "sbscan", i);
+    unlink(file);
+  }
+  unlink("sbdir");
+  exit(0);
+}
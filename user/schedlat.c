@@ -0,0 +1,55 @@
+// Print the kernel's scheduling latency histograms.
+//
+// usage: schedlat [-r]
+//
+// With -r, also reset them.
+
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/sched.h"
+#include "user/user.h"
+
+uint64
+total(uint64 *h)
+{
+  uint64 n = 0;
+
+  for(int i = 0; i < NLATBUCKET; i++)
+    n += h[i];
+  return n;
+}
+
+void
+print(char *what, uint64 *h)
+{
+  int i;
+
+  printf("%s:\n", what);
+  for(i = 0; i < NLATBUCKET; i++)
+    if(h[i])
+      printf("  < %lu us: %lu\n", 2UL << i, h[i]);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct schedlat sl;
+  int cpu, flags = 0;
+
+  if(argc > 1 && strcmp(argv[1], "-r") == 0)
+    flags = SCHEDLAT_RESET;
+
+  for(cpu = 0; cpu < NCPU; cpu++){
+    if(schedlat(cpu, &sl, flags) < 0){
+      fprintf(2, "schedlat: failed\n");
+      exit(1);
+    }
+    if(total(sl.wakeup) + total(sl.preempt) == 0)
+      continue;
+    printf("cpu %d\n", cpu);
+    print("wakeup", sl.wakeup);
+    print("preempt", sl.preempt);
+  }
+  exit(0);
+}
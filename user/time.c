@@ -0,0 +1,41 @@
+// Run a command and report the resources it used.
+//
+// usage: time command [args...]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/rusage.h"
+#include "user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  struct rusage ru;
+  int pid, xstatus, t0;
+
+  if(argc < 2){
+    fprintf(2, "usage: time command [args...]\n");
+    exit(1);
+  }
+
+  t0 = uptime();
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "time: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    exec(argv[1], argv + 1);
+    fprintf(2, "time: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+  if(wait4(pid, &xstatus, 0, &ru) < 0){
+    fprintf(2, "time: wait4 failed\n");
+    exit(1);
+  }
+  printf("%d ticks real, %lu ms user, %lu ms sys\n",
+         uptime() - t0, ru.utime / 1000, ru.stime / 1000);
+  printf("%d voluntary and %d involuntary switches, %d page faults\n",
+         ru.nvcsw, ru.nivcsw, ru.nfault);
+  exit(xstatus);
+}
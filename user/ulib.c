@@ -1,6 +1,10 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
 #include "kernel/fcntl.h"
+#include "kernel/futex.h"
+#include "kernel/ushared.h"
+#include "kernel/syscall.h"
+#include "kernel/batch.h"
 #include "user/user.h"
 
 //
@@ -84,15 +88,17 @@ gets(char *buf, int max)
 int
 stat(const char *n, struct stat *st)
 {
-  int fd;
-  int r;
+  // open, fstat and close in one trap. if the open
+  // fails, so do the others, since fd -1 is not valid.
+  struct sysent e[3] = {
+    { SYS_open, 0, { (uint64)n, O_RDONLY } },
+    { SYS_fstat, 1, { 0, (uint64)st } },
+    { SYS_close, 2 },
+  };
 
-  fd = open(n, O_RDONLY);
-  if(fd < 0)
+  if(batch(e, 3, 0) != 3 || e[0].ret == -1)
     return -1;
-  r = fstat(fd, st);
-  close(fd);
-  return r;
+  return e[1].ret;
 }
 
 int
@@ -145,3 +151,123 @@ memcpy(void *dst, const void *src, uint n)
 {
   return memmove(dst, src, n);
 }
+
+// Mutexes and condition variables for threads (or processes
+// sharing memory), which sleep in futex() when contended.
+
+void
+mutex_init(struct mutex *m)
+{
+  m->state = 0;
+}
+
+void
+mutex_lock(struct mutex *m)
+{
+  int c;
+
+  if((c = __sync_val_compare_and_swap(&m->state, 0, 1)) == 0)
+    return;
+  // mark the mutex contended, so that the holder's
+  // unlock knows to wake us.
+  if(c != 2)
+    c = __sync_lock_test_and_set(&m->state, 2);
+  while(c != 0){
+    futex(&m->state, FUTEX_WAIT, 2);
+    c = __sync_lock_test_and_set(&m->state, 2);
+  }
+}
+
+void
+mutex_unlock(struct mutex *m)
+{
+  if(__sync_fetch_and_sub(&m->state, 1) != 1){
+    // there may be waiters.
+    __sync_lock_release(&m->state);
+    futex(&m->state, FUTEX_WAKE, 1);
+  }
+}
+
+void
+cond_init(struct cond *c)
+{
+  c->seq = 0;
+}
+
+// Release m and wait for cond_signal() or cond_broadcast()
+// on c, then reacquire m. Like any condition variable,
+// callers should recheck their condition when it returns.
+void
+cond_wait(struct cond *c, struct mutex *m)
+{
+  int seq = c->seq;
+
+  mutex_unlock(m);
+  futex(&c->seq, FUTEX_WAIT, seq);
+  mutex_lock(m);
+}
+
+void
+cond_signal(struct cond *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  futex(&c->seq, FUTEX_WAKE, 1);
+}
+
+void
+cond_broadcast(struct cond *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  futex(&c->seq, FUTEX_WAKE, 0x7fffffff);
+}
+
+// The page the kernel shares with this thread; exec() and
+// clone() point tp at it. Reading it is much cheaper than
+// a system call.
+static volatile struct ushared*
+ushared(void)
+{
+  volatile struct ushared *u;
+
+  asm volatile("mv %0, tp" : "=r" (u));
+  return u;
+}
+
+// Like getpid().
+int
+ugetpid(void)
+{
+  return ushared()->pid;
+}
+
+// The calling thread's ID.
+int
+ugettid(void)
+{
+  return ushared()->tid;
+}
+
+// The CPU the calling thread was running on recently.
+int
+ugetcpu(void)
+{
+  return ushared()->cpu;
+}
+
+// Like uptime(), but may lag it by a tick.
+uint
+uuptime(void)
+{
+  return ushared()->ticks;
+}
+
+// Microseconds since the kernel started, from the time CSR.
+uint64
+uclock(void)
+{
+  volatile struct ushared *u = ushared();
+  uint64 t;
+
+  asm volatile("rdtime %0" : "=r" (t));
+  return (t - u->boottime) / (u->timefreq / 1000000);
+}
@@ -1,4 +1,10 @@
 struct stat;
+struct sched_attr;
+struct rusage;
+struct schedlat;
+struct sysent;
+struct lockstat;
+struct cachestat;
 
 // system calls
 int fork(void);
@@ -22,8 +28,29 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+int sched_setattr(int, struct sched_attr*);
+int sched_getattr(int, struct sched_attr*);
+int sched_yield(void);
+int clone(void (*)(void*), void*, void*);
+int join(int, int*);
+int futex(int*, int, int);
+int sched_setaffinity(int, uint64);
+int sched_getaffinity(int, uint64*);
+int getrusage(int, struct rusage*);
+int wait4(int, int*, int, struct rusage*);
+int schedlat(int, struct schedlat*, int);
+int batch(struct sysent*, int, int);
+int lockstat(struct lockstat*, int, int);
+int cachestat(struct cachestat*);
+int bcachelimit(int);
 
 // ulib.c
+struct mutex {
+  int state;    // 0 unlocked, 1 locked, 2 locked with waiters
+};
+struct cond {
+  int seq;      // bumped by each signal
+};
 int stat(const char*, struct stat*);
 char* strcpy(char*, const char*);
 void *memmove(void*, const void*, int);
@@ -39,3 +66,15 @@ void free(void*);
 int atoi(const char*);
 int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
+void mutex_init(struct mutex*);
+void mutex_lock(struct mutex*);
+void mutex_unlock(struct mutex*);
+void cond_init(struct cond*);
+void cond_wait(struct cond*, struct mutex*);
+void cond_signal(struct cond*);
+void cond_broadcast(struct cond*);
+int ugetpid(void);
+int ugettid(void);
+int ugetcpu(void);
+uint uuptime(void);
+uint64 uclock(void);
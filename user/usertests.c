@@ -7,6 +7,12 @@
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
+#include "kernel/sched.h"
+#include "kernel/futex.h"
+#include "kernel/rusage.h"
+#include "kernel/batch.h"
+#include "kernel/lockstat.h"
+#include "kernel/cachestat.h"
 
 //
 // Tests xv6 system calls.  usertests without arguments runs them all
@@ -818,6 +824,24 @@ killstatus(char *s)
   exit(0);
 }
 
+// system calls that look up a pid should reject negative
+// pids rather than index the pid hash table with them.
+void
+killbadpid(char *s)
+{
+  struct sched_attr attr;
+  uint64 mask;
+
+  if(kill(-1) != -1 || kill(-12345) != -1){
+    printf("%s: kill of a negative pid succeeded\n", s);
+    exit(1);
+  }
+  if(sched_getattr(-1, &attr) != -1 || sched_getaffinity(-7, &mask) != -1){
+    printf("%s: lookup of a negative pid succeeded\n", s);
+    exit(1);
+  }
+}
+
 // meant to be run w/ at most two CPUs
 void
 preempt(char *s)
@@ -1962,7 +1986,7 @@ iref(char *s)
 void
 forktest(char *s)
 {
-  enum{ N = 1000 };
+  enum{ N = NPROC + 1 };
   int n, pid;
 
   for(n=0; n<N; n++){
@@ -1979,7 +2003,7 @@ forktest(char *s)
   }
 
   if(n == N){
-    printf("%s: fork claimed to work 1000 times!\n", s);
+    printf("%s: fork claimed to work %d times!\n", s, N);
     exit(1);
   }
 
@@ -2581,6 +2605,1268 @@ badarg(char *s)
   exit(0);
 }
 
+// sched_setattr() and sched_getattr() agree, reject bad
+// parameters, and fork() passes the weight on to the child.
+void
+schedattr(char *s)
+{
+  struct sched_attr attr;
+  int pid, xstatus;
+
+  if(sched_getattr(0, &attr) < 0){
+    printf("%s: sched_getattr failed\n", s);
+    exit(1);
+  }
+  if(attr.policy != SCHED_NORMAL || attr.weight != WEIGHT_DEFAULT){
+    printf("%s: unexpected policy %d weight %d\n", s, attr.policy, attr.weight);
+    exit(1);
+  }
+
+  attr.weight = 2*WEIGHT_DEFAULT;
+  if(sched_setattr(getpid(), &attr) < 0){
+    printf("%s: sched_setattr failed\n", s);
+    exit(1);
+  }
+  attr.weight = 0;
+  if(sched_getattr(getpid(), &attr) < 0 || attr.weight != 2*WEIGHT_DEFAULT){
+    printf("%s: weight did not stick\n", s);
+    exit(1);
+  }
+
+  attr.weight = WEIGHT_MIN - 1;
+  if(sched_setattr(0, &attr) != -1){
+    printf("%s: sched_setattr accepted weight %d\n", s, attr.weight);
+    exit(1);
+  }
+  attr.weight = WEIGHT_MAX + 1;
+  if(sched_setattr(0, &attr) != -1){
+    printf("%s: sched_setattr accepted weight %d\n", s, attr.weight);
+    exit(1);
+  }
+  attr.weight = WEIGHT_DEFAULT;
+  attr.policy = -1;
+  if(sched_setattr(0, &attr) != -1){
+    printf("%s: sched_setattr accepted policy -1\n", s);
+    exit(1);
+  }
+  if(sched_getattr(1000000, &attr) != -1){
+    printf("%s: sched_getattr found pid 1000000\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(sched_getattr(0, &attr) < 0 || attr.weight != 2*WEIGHT_DEFAULT)
+      exit(1);
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child did not inherit weight\n", s);
+    exit(1);
+  }
+}
+
+// SCHED_DEADLINE parameter checks, admission control, and
+// periodic jobs that should meet their deadlines despite
+// CPU-bound SCHED_NORMAL processes.
+void
+deadline(char *s)
+{
+  struct sched_attr attr;
+  int fds[2], pids[NCPU+1], hogs[NCPU];
+  int i, n, t0;
+  char ok;
+
+  sched_getattr(0, &attr);
+  attr.policy = SCHED_DEADLINE;
+  attr.runtime = 2000;
+  attr.deadline = 1000;
+  attr.period = 10000;
+  if(sched_setattr(0, &attr) != -1){
+    printf("%s: sched_setattr accepted runtime > deadline\n", s);
+    exit(1);
+  }
+  attr.runtime = 0;
+  if(sched_setattr(0, &attr) != -1){
+    printf("%s: sched_setattr accepted runtime 0\n", s);
+    exit(1);
+  }
+  attr.runtime = 1000;
+  attr.deadline = 20000;
+  if(sched_setattr(0, &attr) != -1){
+    printf("%s: sched_setattr accepted deadline > period\n", s);
+    exit(1);
+  }
+
+  // each child asks for 90% of a CPU; admission control
+  // must turn one away before there are more than NCPU.
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  for(n = 0; n < NCPU+1; n++){
+    pids[n] = fork();
+    if(pids[n] < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pids[n] == 0){
+      close(fds[0]);
+      attr.runtime = 9000;
+      attr.deadline = attr.period = 10000;
+      ok = sched_setattr(0, &attr) == 0;
+      write(fds[1], &ok, 1);
+      while(ok)
+        sched_yield();
+      exit(0);
+    }
+    if(read(fds[0], &ok, 1) != 1){
+      printf("%s: read failed\n", s);
+      exit(1);
+    }
+    if(!ok)
+      break;
+  }
+  close(fds[0]);
+  close(fds[1]);
+  for(i = 0; i <= n && i < NCPU+1; i++){
+    kill(pids[i]);
+    wait(0);
+  }
+  if(n == NCPU+1){
+    printf("%s: admitted %d processes at 90%% of a CPU\n", s, n);
+    exit(1);
+  }
+  if(n == 0){
+    printf("%s: no deadline process admitted\n", s);
+    exit(1);
+  }
+
+  // the children's bandwidth is free again.
+  for(i = 0; i < NCPU; i++){
+    hogs[i] = fork();
+    if(hogs[i] < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(hogs[i] == 0)
+      for(;;)
+        ;
+  }
+  attr.runtime = 2000;
+  attr.deadline = attr.period = 10000;
+  if(sched_setattr(0, &attr) < 0){
+    printf("%s: bandwidth not released\n", s);
+    exit(1);
+  }
+  t0 = uptime();
+  for(i = 0; i < 50; i++)
+    sched_yield();
+  t0 = uptime() - t0;
+  sched_getattr(0, &attr);
+  attr.policy = SCHED_NORMAL;
+  sched_setattr(0, &attr);
+  for(i = 0; i < NCPU; i++){
+    kill(hogs[i]);
+    wait(0);
+  }
+
+  // 50 periods of 10ms is about 5 ticks.
+  if(t0 < 3){
+    printf("%s: 50 periods took only %d ticks\n", s, t0);
+    exit(1);
+  }
+  if(attr.misses > 5){
+    printf("%s: %d of 50 jobs missed their deadline\n", s, attr.misses);
+    exit(1);
+  }
+}
+
+// a SCHED_DEADLINE process that waits for a sleeplock held
+// by a SCHED_NORMAL process (here a file's offset lock, held
+// for the whole of a long write()) should not also wait while
+// CPU-bound SCHED_NORMAL processes share the holder's CPU.
+void
+dlinherit(char *s)
+{
+  enum { NHOG = 3, SZ = 200*1024 };
+  static char buf[SZ];
+  struct sched_attr attr;
+  int fd, i, pid, hogs[NHOG];
+  uint64 t;
+
+  fd = open("dlinherit", O_CREATE|O_TRUNC|O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  // the children inherit the affinity.
+  if(sched_setaffinity(0, 1) < 0){
+    printf("%s: sched_setaffinity failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < NHOG; i++){
+    hogs[i] = fork();
+    if(hogs[i] < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(hogs[i] == 0)
+      for(;;)
+        ;
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    write(fd, buf, SZ);
+    exit(0);
+  }
+
+  // let the holder get well into its write.
+  sleep(1);
+  sched_getattr(0, &attr);
+  attr.policy = SCHED_DEADLINE;
+  attr.runtime = 2000;
+  attr.deadline = attr.period = 10000;
+  if(sched_setattr(0, &attr) < 0){
+    printf("%s: sched_setattr failed\n", s);
+    exit(1);
+  }
+  t = uclock();
+  write(fd, buf, 1);
+  t = uclock() - t;
+  attr.policy = SCHED_NORMAL;
+  sched_setattr(0, &attr);
+
+  for(i = 0; i < NHOG; i++){
+    kill(hogs[i]);
+    wait(0);
+  }
+  wait(0);
+  close(fd);
+  unlink("dlinherit");
+
+  // alone, the holder's write takes well under a second; each
+  // time it waited behind the hogs would cost several ticks.
+  if(t > 3000000){
+    printf("%s: deadline process waited %lu ms\n", s, t / 1000);
+    exit(1);
+  }
+}
+
+volatile int thread_counter;
+volatile int thread_pid;
+char *thread_brk;
+
+void
+thread_add(void *arg)
+{
+  for(int i = 0; i < 1000; i++)
+    __sync_fetch_and_add(&thread_counter, 1);
+  thread_pid = getpid();
+  exit((int)(uint64)arg);
+}
+
+void
+thread_sbrk(void *arg)
+{
+  thread_brk = sbrk(PGSIZE);
+  thread_brk[0] = 'x';
+  exit(0);
+}
+
+void
+thread_fork(void *arg)
+{
+  int pid;
+
+  pid = fork();
+  if(pid == 0)
+    exit(5);
+  exit(pid < 0);
+}
+
+void
+thread_spin(void *arg)
+{
+  for(;;)
+    ;
+}
+
+// threads made by clone() share memory with the process,
+// and go away when its first thread exits.
+void
+threads(char *s)
+{
+  char *stacks[4];
+  int tids[4], i, tid, xstatus, pid;
+
+  thread_counter = 0;
+  for(i = 0; i < 4; i++){
+    stacks[i] = malloc(PGSIZE);
+    tids[i] = clone(thread_add, (void*)(uint64)i, stacks[i] + PGSIZE);
+    if(tids[i] < 0){
+      printf("%s: clone failed\n", s);
+      exit(1);
+    }
+  }
+  for(i = 0; i < 4; i++){
+    if(join(tids[i], &xstatus) != tids[i] || xstatus != i){
+      printf("%s: join %d failed\n", s, tids[i]);
+      exit(1);
+    }
+    free(stacks[i]);
+  }
+  if(thread_counter != 4000){
+    printf("%s: counter %d, expected 4000\n", s, thread_counter);
+    exit(1);
+  }
+  if(thread_pid != getpid()){
+    printf("%s: thread getpid %d, process %d\n", s, thread_pid, getpid());
+    exit(1);
+  }
+  if(join(0, 0) != -1){
+    printf("%s: join with no threads succeeded\n", s);
+    exit(1);
+  }
+
+  // memory that a thread allocates is the process's.
+  stacks[0] = malloc(PGSIZE);
+  tid = clone(thread_sbrk, 0, stacks[0] + PGSIZE);
+  if(tid < 0 || join(tid, 0) != tid){
+    printf("%s: sbrk thread failed\n", s);
+    exit(1);
+  }
+  if(thread_brk[0] != 'x' || sbrk(0) != thread_brk + PGSIZE){
+    printf("%s: thread's sbrk not visible\n", s);
+    exit(1);
+  }
+  sbrk(-PGSIZE);
+  free(stacks[0]);
+
+  // the children of a thread that exits are the process's.
+  stacks[0] = malloc(PGSIZE);
+  tid = clone(thread_fork, 0, stacks[0] + PGSIZE);
+  if(tid < 0 || join(tid, &xstatus) != tid || xstatus != 0){
+    printf("%s: fork thread failed\n", s);
+    exit(1);
+  }
+  free(stacks[0]);
+  if(wait(&xstatus) < 0 || xstatus != 5){
+    printf("%s: thread's child not passed to the process\n", s);
+    exit(1);
+  }
+
+  // exit() in the first thread ends the others.
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(i = 0; i < 3; i++)
+      if(clone(thread_spin, 0, malloc(PGSIZE) + PGSIZE) < 0)
+        exit(1);
+    // and the spinning threads see this shrink.
+    sbrk(-PGSIZE);
+    exit(7);
+  }
+  wait(&xstatus);
+  if(xstatus != 7){
+    printf("%s: threaded child exit status %d\n", s, xstatus);
+    exit(1);
+  }
+}
+
+struct mutex futex_mutex;
+struct cond futex_cond;
+volatile int futex_flag;
+
+void
+futex_add(void *arg)
+{
+  for(int i = 0; i < 1000; i++){
+    mutex_lock(&futex_mutex);
+    // a non-atomic increment, to catch a broken mutex.
+    int n = thread_counter;
+    if(i % 100 == 0)
+      sleep(0);
+    thread_counter = n + 1;
+    mutex_unlock(&futex_mutex);
+  }
+  exit(0);
+}
+
+void
+futex_waiter(void *arg)
+{
+  mutex_lock(&futex_mutex);
+  while(futex_flag == 0)
+    cond_wait(&futex_cond, &futex_mutex);
+  mutex_unlock(&futex_mutex);
+  exit(0);
+}
+
+// futex() and the mutex and condition variable built on it.
+void
+futextest(char *s)
+{
+  int x = 5;
+  char *stacks[4];
+  int tids[4], i;
+
+  if(futex(&x, FUTEX_WAIT, 6) != -1){
+    printf("%s: futex waited for the wrong value\n", s);
+    exit(1);
+  }
+  if(futex(&x, FUTEX_WAKE, 1) != 0){
+    printf("%s: futex woke a waiter that does not exist\n", s);
+    exit(1);
+  }
+  if(futex((int*)((char*)&x + 1), FUTEX_WAKE, 1) != -1 ||
+     futex((int*)0xffffffff0, FUTEX_WAKE, 1) != -1){
+    printf("%s: futex accepted a bad address\n", s);
+    exit(1);
+  }
+
+  mutex_init(&futex_mutex);
+  thread_counter = 0;
+  for(i = 0; i < 4; i++){
+    stacks[i] = malloc(PGSIZE);
+    if((tids[i] = clone(futex_add, 0, stacks[i] + PGSIZE)) < 0){
+      printf("%s: clone failed\n", s);
+      exit(1);
+    }
+  }
+  for(i = 0; i < 4; i++)
+    join(tids[i], 0);
+  if(thread_counter != 4000){
+    printf("%s: counter %d, expected 4000\n", s, thread_counter);
+    exit(1);
+  }
+
+  cond_init(&futex_cond);
+  futex_flag = 0;
+  for(i = 0; i < 4; i++){
+    if((tids[i] = clone(futex_waiter, 0, stacks[i] + PGSIZE)) < 0){
+      printf("%s: clone failed\n", s);
+      exit(1);
+    }
+  }
+  sleep(1);
+  mutex_lock(&futex_mutex);
+  futex_flag = 1;
+  cond_broadcast(&futex_cond);
+  mutex_unlock(&futex_mutex);
+  for(i = 0; i < 4; i++){
+    if(join(tids[i], 0) != tids[i]){
+      printf("%s: join failed\n", s);
+      exit(1);
+    }
+    free(stacks[i]);
+  }
+}
+
+// a process pinned to one CPU stays there.
+void
+affinity(char *s)
+{
+  struct sched_attr attr;
+  uint64 mask;
+  int i, pid, xstatus, m0;
+
+  if(sched_getaffinity(0, &mask) < 0 || (mask & 1) == 0){
+    printf("%s: sched_getaffinity failed\n", s);
+    exit(1);
+  }
+  if(sched_setaffinity(0, 0) != -1){
+    printf("%s: sched_setaffinity accepted an empty mask\n", s);
+    exit(1);
+  }
+  if(sched_setaffinity(1000000, 1) != -1){
+    printf("%s: sched_setaffinity found pid 1000000\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(sched_setaffinity(0, 1) < 0 ||
+       sched_getaffinity(0, &mask) < 0 || mask != 1)
+      exit(1);
+    sched_getattr(0, &attr);
+    m0 = attr.migrations;
+    for(i = 0; i < 100; i++)
+      sched_yield();
+    sched_getattr(0, &attr);
+    if(attr.migrations != m0)
+      exit(2);
+    // a child inherits the mask.
+    pid = fork();
+    if(pid == 0){
+      sched_getaffinity(0, &mask);
+      exit(mask == 1 ? 0 : 3);
+    }
+    wait(&xstatus);
+    exit(xstatus);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: pinned process failed (%d)\n", s, xstatus);
+    exit(1);
+  }
+}
+
+// wait4() reports the CPU time and context switches
+// of a child, and getrusage() adds them to the parent's.
+void
+rusagetest(char *s)
+{
+  struct rusage ru, cru;
+  int pid, xstatus, t0;
+
+  if(getrusage(5, &ru) != -1){
+    printf("%s: getrusage accepted a bad who\n", s);
+    exit(1);
+  }
+  if(wait4(-1, 0, WNOHANG, &ru) != -1){
+    printf("%s: wait4 without children did not fail\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    sleep(1);
+    // spin in user space for a few ticks.
+    t0 = uptime();
+    while(uptime() - t0 < 3)
+      ;
+    exit(7);
+  }
+  if(wait4(pid, 0, WNOHANG, &ru) != 0){
+    printf("%s: wait4 WNOHANG did not return 0\n", s);
+    exit(1);
+  }
+  if(wait4(pid + 1, 0, 0, &ru) != -1){
+    printf("%s: wait4 found a stranger\n", s);
+    exit(1);
+  }
+  if(wait4(pid, &xstatus, 0, &ru) != pid || xstatus != 7){
+    printf("%s: wait4 failed\n", s);
+    exit(1);
+  }
+  if(ru.utime == 0 || ru.nvcsw == 0){
+    printf("%s: child used utime %lu, nvcsw %d\n", s, ru.utime, ru.nvcsw);
+    exit(1);
+  }
+  if(getrusage(RUSAGE_CHILDREN, &cru) < 0 || cru.utime < ru.utime){
+    printf("%s: children's utime %lu < %lu\n", s, cru.utime, ru.utime);
+    exit(1);
+  }
+  if(getrusage(RUSAGE_SELF, &ru) < 0 || ru.stime == 0){
+    printf("%s: getrusage(RUSAGE_SELF) failed\n", s);
+    exit(1);
+  }
+}
+
+// a process that sleeps shows up in the wakeup histogram.
+void
+schedlattest(char *s)
+{
+  struct schedlat sl;
+  uint64 n;
+  int i;
+
+  if(schedlat(-2, &sl, 0) != -1 || schedlat(NCPU, &sl, 0) != -1){
+    printf("%s: schedlat accepted a bad cpu\n", s);
+    exit(1);
+  }
+  sleep(1);
+  if(schedlat(-1, &sl, 0) < 0){
+    printf("%s: schedlat failed\n", s);
+    exit(1);
+  }
+  n = 0;
+  for(i = 0; i < NLATBUCKET; i++)
+    n += sl.wakeup[i];
+  if(n == 0){
+    printf("%s: no wakeups counted\n", s);
+    exit(1);
+  }
+}
+
+// processes reading one file at once, some through their own
+// descriptors and some through one shared descriptor, see
+// the right data, and the shared offset loses no reads.
+void
+sharedread(char *s)
+{
+  enum { N = 4, SZ = 8*1024 };
+  static char buf[SZ];
+  char *file = "sharedread";
+  int fd, sfd, i, j, n, pid, fds[2], xstatus;
+
+  fd = open(file, O_CREATE|O_TRUNC|O_WRONLY);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < SZ; i++)
+    buf[i] = 'a' + i % 26;
+  if(write(fd, buf, SZ) != SZ){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  sfd = open(file, O_RDONLY);
+  if(sfd < 0 || pipe(fds) < 0){
+    printf("%s: open failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 2*N; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      char b[64];
+      if(i < N){
+        // own descriptor: read it all, several times.
+        for(j = 0; j < 10; j++){
+          fd = open(file, O_RDONLY);
+          while(read(fd, b, sizeof(b)) > 0)
+            ;
+          close(fd);
+        }
+        fd = open(file, O_RDONLY);
+        for(j = 0; j < SZ; j += sizeof(b)){
+          if(read(fd, b, sizeof(b)) != sizeof(b) ||
+             b[0] != 'a' + j % 26){
+            printf("%s: wrong data\n", s);
+            exit(1);
+          }
+        }
+        exit(0);
+      }
+      // shared descriptor: count what this process read.
+      n = 0;
+      while((j = read(sfd, b, sizeof(b))) > 0)
+        n += j;
+      write(fds[1], &n, sizeof(n));
+      exit(0);
+    }
+  }
+  close(fds[1]);
+  close(sfd);
+  for(i = 0; i < 2*N; i++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(1);
+  }
+  j = 0;
+  while(read(fds[0], &n, sizeof(n)) == sizeof(n))
+    j += n;
+  close(fds[0]);
+  unlink(file);
+  if(j != SZ){
+    printf("%s: shared descriptor read %d bytes, not %d\n", s, j, SZ);
+    exit(1);
+  }
+}
+
+// the buffer cache grows to hold a set of files much bigger
+// than NBUF blocks, so that reading them again hits.
+void
+bcachegrow(char *s)
+{
+  enum { NF = 4, SZ = 200*1024 };
+  static char buf[BSIZE];
+  struct cachestat st0, st1;
+  char name[4];
+  int i, j, fd;
+
+  name[0] = 'b';
+  name[1] = 'c';
+  name[3] = 0;
+  for(i = 0; i < NF; i++){
+    name[2] = '0' + i;
+    fd = open(name, O_CREATE|O_TRUNC|O_WRONLY);
+    if(fd < 0){
+      printf("%s: create failed\n", s);
+      exit(1);
+    }
+    for(j = 0; j < SZ; j += sizeof(buf)){
+      if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+        printf("%s: write failed\n", s);
+        exit(1);
+      }
+    }
+    close(fd);
+  }
+
+  for(int pass = 0; pass < 2; pass++){
+    if(cachestat(&st0) < 0){
+      printf("%s: cachestat failed\n", s);
+      exit(1);
+    }
+    for(i = 0; i < NF; i++){
+      name[2] = '0' + i;
+      fd = open(name, O_RDONLY);
+      while(read(fd, buf, sizeof(buf)) > 0)
+        ;
+      close(fd);
+    }
+    cachestat(&st1);
+  }
+  for(i = 0; i < NF; i++){
+    name[2] = '0' + i;
+    unlink(name);
+  }
+
+  if(st1.nbuf < NF*SZ/BSIZE){
+    printf("%s: cache only %lu buffers\n", s, st1.nbuf);
+    exit(1);
+  }
+  // the second pass should read (almost) nothing from disk.
+  if(st1.bmiss - st0.bmiss > (NF*SZ/BSIZE) / 10){
+    printf("%s: %lu misses reading cached files\n", s, st1.bmiss - st0.bmiss);
+    exit(1);
+  }
+}
+
+// several processes write and read back files at once
+// with the buffer cache small, so that many disk requests
+// are in flight together.
+void
+diskqueue(char *s)
+{
+  enum { NP = 6, NB = 60 };
+  static char buf[BSIZE];
+  struct cachestat st0, st1;
+  char name[4];
+  int i, j, k, n, fd, pid, old, xstatus;
+
+  cachestat(&st0);
+  old = bcachelimit(1);
+  name[0] = 'd';
+  name[1] = 'q';
+  name[3] = 0;
+  xstatus = 0;
+  for(n = 0; n < NP; n++){
+    i = n;
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      xstatus = 1;
+      break;
+    }
+    if(pid == 0){
+      name[2] = '0' + i;
+      fd = open(name, O_CREATE|O_TRUNC|O_WRONLY);
+      if(fd < 0){
+        printf("%s: create failed\n", s);
+        exit(1);
+      }
+      for(j = 0; j < NB; j++){
+        memset(buf, i*NB + j, sizeof(buf));
+        if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+          printf("%s: write failed\n", s);
+          exit(1);
+        }
+      }
+      close(fd);
+      fd = open(name, O_RDONLY);
+      for(j = 0; j < NB; j++){
+        if(read(fd, buf, sizeof(buf)) != sizeof(buf)){
+          printf("%s: read failed\n", s);
+          exit(1);
+        }
+        for(k = 0; k < sizeof(buf); k++){
+          if(buf[k] != (char)(i*NB + j)){
+            printf("%s: wrong data in block %d of %s\n", s, j, name);
+            exit(1);
+          }
+        }
+      }
+      close(fd);
+      unlink(name);
+      exit(0);
+    }
+  }
+  for(i = 0; i < n; i++){
+    wait(&k);
+    if(k != 0)
+      xstatus = k;
+  }
+  bcachelimit(old);
+  cachestat(&st1);
+  if(xstatus == 0 && (st1.dreq == st0.dreq || st1.dintr == st0.dintr)){
+    printf("%s: disk requests not counted\n", s);
+    exit(1);
+  }
+  exit(xstatus);
+}
+
+// reading a file from start to end, which is not in the
+// buffer cache, should read ahead, and get the right data.
+void
+readaheadtest(char *s)
+{
+  enum { NB = 150 };
+  static char buf[BSIZE];
+  struct cachestat st0, st1;
+  int i, j, fd, old, xstatus;
+  char *names[] = { "ra0", "ra1" };
+
+  for(i = 0; i < 2; i++){
+    fd = open(names[i], O_CREATE|O_TRUNC|O_WRONLY);
+    if(fd < 0){
+      printf("%s: create failed\n", s);
+      exit(1);
+    }
+    for(j = 0; j < NB; j++){
+      memset(buf, i*NB + j, sizeof(buf));
+      if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+        printf("%s: write failed\n", s);
+        exit(1);
+      }
+    }
+    close(fd);
+  }
+
+  // with the cache small, reading ra1 pushes ra0 out of it.
+  old = bcachelimit(1);
+  fd = open("ra1", O_RDONLY);
+  while(read(fd, buf, sizeof(buf)) > 0)
+    ;
+  close(fd);
+
+  xstatus = 0;
+  cachestat(&st0);
+  fd = open("ra0", O_RDONLY);
+  for(j = 0; j < NB && xstatus == 0; j++){
+    if(read(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf("%s: read failed\n", s);
+      xstatus = 1;
+      break;
+    }
+    for(i = 0; i < sizeof(buf); i++){
+      if(buf[i] != (char)j){
+        printf("%s: wrong data in block %d\n", s, j);
+        xstatus = 1;
+        break;
+      }
+    }
+  }
+  close(fd);
+  cachestat(&st1);
+  bcachelimit(old);
+  unlink("ra0");
+  unlink("ra1");
+
+  if(xstatus == 0 && st1.breadahead == st0.breadahead){
+    printf("%s: no blocks read ahead\n", s);
+    xstatus = 1;
+  }
+  exit(xstatus);
+}
+
+// many processes reading files from start to end at once,
+// with the buffer cache as small as it goes, must not run
+// the cache out of buffers with reads ahead.
+void
+readaheadmany(char *s)
+{
+  enum { NP = 8, NB = 100 };
+  static char buf[BSIZE];
+  char name[4];
+  int i, j, k, n, fd, pid, old, xstatus;
+
+  name[0] = 'r';
+  name[1] = 'm';
+  name[3] = 0;
+  for(i = 0; i < NP; i++){
+    name[2] = '0' + i;
+    fd = open(name, O_CREATE|O_TRUNC|O_WRONLY);
+    if(fd < 0){
+      printf("%s: create failed\n", s);
+      exit(1);
+    }
+    for(j = 0; j < NB; j++){
+      memset(buf, i*NB + j, sizeof(buf));
+      if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+        printf("%s: write failed\n", s);
+        exit(1);
+      }
+    }
+    close(fd);
+  }
+
+  old = bcachelimit(1);
+  xstatus = 0;
+  for(n = 0; n < NP; n++){
+    i = n;
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      xstatus = 1;
+      break;
+    }
+    if(pid == 0){
+      name[2] = '0' + i;
+      fd = open(name, O_RDONLY);
+      if(fd < 0){
+        printf("%s: open failed\n", s);
+        exit(1);
+      }
+      for(j = 0; j < NB; j++){
+        if(read(fd, buf, sizeof(buf)) != sizeof(buf)){
+          printf("%s: read failed\n", s);
+          exit(1);
+        }
+        for(k = 0; k < sizeof(buf); k++){
+          if(buf[k] != (char)(i*NB + j)){
+            printf("%s: wrong data in block %d of %s\n", s, j, name);
+            exit(1);
+          }
+        }
+      }
+      close(fd);
+      exit(0);
+    }
+  }
+  for(i = 0; i < n; i++){
+    wait(&k);
+    if(k != 0)
+      xstatus = k;
+  }
+  bcachelimit(old);
+  for(i = 0; i < NP; i++){
+    name[2] = '0' + i;
+    unlink(name);
+  }
+  exit(xstatus);
+}
+
+// looking up a directory counts inode table and buffer
+// cache hits.
+void
+cachestattest(char *s)
+{
+  struct cachestat st0, st1;
+  struct stat sb;
+
+  if(cachestat(&st0) < 0){
+    printf("%s: cachestat failed\n", s);
+    exit(1);
+  }
+  if(stat(".", &sb) < 0 || stat("/", &sb) < 0){
+    printf("%s: stat failed\n", s);
+    exit(1);
+  }
+  cachestat(&st1);
+  if(st1.ninode != NINODE || st1.iused == 0 || st1.iused > NINODE){
+    printf("%s: bad inode table counts\n", s);
+    exit(1);
+  }
+  if(bcachelimit(0) != st1.maxbuf){
+    printf("%s: bcachelimit and cachestat disagree\n", s);
+    exit(1);
+  }
+  if(st1.ihit + st1.imiss <= st0.ihit + st0.imiss ||
+     st1.bhit + st1.bmiss <= st0.bhit + st0.bmiss){
+    printf("%s: lookups not counted\n", s);
+    exit(1);
+  }
+}
+
+// the allocator's lock is counted as it is acquired.
+void
+lockstattest(char *s)
+{
+  static struct lockstat ls[NLOCKCLASS];
+  char *p;
+  int i, n;
+
+  p = sbrk(PGSIZE);
+  if(p == (char*)-1){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  n = lockstat(ls, NLOCKCLASS, 0);
+  if(n <= 0 || n > NLOCKCLASS){
+    printf("%s: lockstat returned %d\n", s, n);
+    exit(1);
+  }
+  for(i = 0; i < n; i++)
+    if(strcmp(ls[i].name, "kmem") == 0 && ls[i].sleep == 0)
+      break;
+  if(i == n || ls[i].nacquire == 0){
+    printf("%s: no kmem acquisitions counted\n", s);
+    exit(1);
+  }
+  if(ls[i].ncontended > ls[i].nacquire){
+    printf("%s: more contended than acquired\n", s);
+    exit(1);
+  }
+}
+
+// a floating-point computation whose result depends on
+// every step, giving up the CPU now and then if yield.
+double
+fpwork(double seed, int yield)
+{
+  double x = seed;
+
+  for(int i = 0; i < 20000; i++){
+    x = x * 1.0000001 + 0.25 / (i + 1);
+    if(yield && i % 500 == 0)
+      sched_yield();
+  }
+  return x;
+}
+
+// add 1 to each element of v n times, all within vector
+// registers, so that timer interrupts come in between.
+// without a vector unit, the kernel kills the process.
+void
+vecwork(int *v, int n)
+{
+  asm volatile(".option push\n"
+               ".option arch, +v\n"
+               "vsetivli zero, 4, e32, m1, ta, ma\n"
+               "vle32.v v8, (%0)\n"
+               "1: vadd.vi v8, v8, 1\n"
+               "addi %1, %1, -1\n"
+               "bnez %1, 1b\n"
+               "vse32.v v8, (%0)\n"
+               ".option pop\n"
+               : "+r" (v), "+r" (n) : : "memory");
+}
+
+// several processes at once use floating-point and vector
+// registers, which must survive their context switches.
+void
+fpvec(char *s)
+{
+  enum { NCHILD = 6, NVEC = 2000000 };
+  int pids[NCHILD];
+  int i, j, xstatus, v[4];
+
+  for(i = 0; i < NCHILD; i++){
+    pids[i] = fork();
+    if(pids[i] < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pids[i] == 0){
+      if(fpwork(i + 1, 0) != fpwork(i + 1, 1))
+        exit(1);
+      exit(0);
+    }
+  }
+  for(i = 0; i < NCHILD; i++){
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("%s: floating-point registers lost\n", s);
+      exit(1);
+    }
+  }
+
+  // is there a vector unit?
+  pids[0] = fork();
+  if(pids[0] == 0){
+    v[0] = 0;
+    vecwork(v, 1);
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: no vector unit, skipping vector test\n", s);
+    return;
+  }
+
+  for(i = 0; i < NCHILD; i++){
+    pids[i] = fork();
+    if(pids[i] < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pids[i] == 0){
+      for(j = 0; j < 4; j++)
+        v[j] = i * 1000 + j;
+      vecwork(v, NVEC);
+      for(j = 0; j < 4; j++)
+        if(v[j] != i * 1000 + j + NVEC)
+          exit(1);
+      // and a floating-point computation after vector
+      // use, in the same process.
+      if(fpwork(i + 1, 0) != fpwork(i + 1, 1))
+        exit(2);
+      exit(0);
+    }
+  }
+  for(i = 0; i < NCHILD; i++){
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("%s: vector registers lost (%d)\n", s, xstatus);
+      exit(1);
+    }
+  }
+}
+
+int usharedtid;
+
+void
+usharedthread(void *arg)
+{
+  usharedtid = ugettid();
+  exit(ugetpid() == getpid() ? 0 : 1);
+}
+
+// ulib's ugetpid() etc. read the page the kernel shares
+// with each thread, which user code cannot write.
+void
+usharedtest(char *s)
+{
+  uint64 t0, t1;
+  char *stack;
+  int pid, tid, xstatus;
+
+  if(ugetpid() != getpid() || ugettid() != getpid()){
+    printf("%s: ugetpid %d, getpid %d\n", s, ugetpid(), getpid());
+    exit(1);
+  }
+  if(ugetcpu() < 0 || ugetcpu() >= NCPU){
+    printf("%s: ugetcpu %d\n", s, ugetcpu());
+    exit(1);
+  }
+  if(uptime() - uuptime() > 1){
+    printf("%s: uuptime %d, uptime %d\n", s, uuptime(), uptime());
+    exit(1);
+  }
+  t0 = uclock();
+  sleep(2);
+  t1 = uclock();
+  if(t1 <= t0 || t1 - t0 > 10000000){
+    printf("%s: uclock went from %lu to %lu\n", s, t0, t1);
+    exit(1);
+  }
+
+  // a thread has a page of its own.
+  stack = sbrk(4096) + 4096;
+  tid = clone(usharedthread, 0, stack);
+  if(tid < 0){
+    printf("%s: clone failed\n", s);
+    exit(1);
+  }
+  if(join(tid, &xstatus) != tid || xstatus != 0 || usharedtid != tid){
+    printf("%s: thread's ushared page is wrong\n", s);
+    exit(1);
+  }
+
+  // so does a fork child.
+  pid = fork();
+  if(pid == 0)
+    exit(ugetpid() == getpid() ? 0 : 1);
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child's ushared page is wrong\n", s);
+    exit(1);
+  }
+
+  // the page is read-only.
+  pid = fork();
+  if(pid == 0){
+    *(volatile int *)USHARED = 0;
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != -1){
+    printf("%s: could write the ushared page\n", s);
+    exit(1);
+  }
+}
+
+// batch() makes several system calls in one trap.
+void
+batchtest(char *s)
+{
+  struct sysent e[4];
+  struct stat st;
+  char buf[8];
+
+  memset(e, 0, sizeof(e));
+  e[0].num = SYS_getpid;
+  e[1].num = 9999;
+  e[2].num = SYS_fork;
+  e[3].num = SYS_uptime;
+  if(batch(e, 4, 0) != 4){
+    printf("%s: batch did not make 4 calls\n", s);
+    exit(1);
+  }
+  if(e[0].ret != getpid() || e[1].ret != -1 || e[2].ret != -1 || e[3].ret == -1){
+    printf("%s: wrong results\n", s);
+    exit(1);
+  }
+
+  // stop at the first failure.
+  e[0].num = SYS_close;
+  e[0].args[0] = -1;
+  e[1].num = SYS_getpid;
+  e[1].ret = 12345;
+  if(batch(e, 2, BATCH_STOPONERR) != 1 || e[0].ret != -1 || e[1].ret != 12345){
+    printf("%s: BATCH_STOPONERR did not stop\n", s);
+    exit(1);
+  }
+
+  // a call can take the file descriptor from an earlier one.
+  memset(e, 0, sizeof(e));
+  e[0].num = SYS_open;
+  e[0].args[0] = (uint64)"README";
+  e[0].args[1] = O_RDONLY;
+  e[1].num = SYS_read;
+  e[1].link = 1;
+  e[1].args[1] = (uint64)buf;
+  e[1].args[2] = sizeof(buf);
+  e[2].num = SYS_fstat;
+  e[2].link = 2;
+  e[2].args[1] = (uint64)&st;
+  e[3].num = SYS_close;
+  e[3].link = 3;
+  if(batch(e, 4, BATCH_STOPONERR) != 4 || e[1].ret != sizeof(buf) ||
+     st.type != T_FILE || e[3].ret != 0){
+    printf("%s: open/read/fstat/close batch failed\n", s);
+    exit(1);
+  }
+  if(stat("README", &st) < 0 || st.type != T_FILE || stat("nonexistent", &st) != -1){
+    printf("%s: stat failed\n", s);
+    exit(1);
+  }
+
+  if(batch((struct sysent*)0xffffffffffL, 1, 0) != -1){
+    printf("%s: batch accepted a bad address\n", s);
+    exit(1);
+  }
+}
+
 struct test {
   void (*f)(char *);
   char *s;
@@ -2605,6 +3891,7 @@ struct test {
   {exectest, "exectest"},
   {pipe1, "pipe1"},
   {killstatus, "killstatus"},
+  {killbadpid, "killbadpid"},
   {preempt, "preempt"},
   {exitwait, "exitwait"},
   {reparent, "reparent" },
@@ -2645,6 +3932,24 @@ struct test {
   {sbrklast, "sbrklast"},
   {sbrk8000, "sbrk8000"},
   {badarg, "badarg" },
+  {schedattr, "schedattr"},
+  {deadline, "deadline"},
+  {dlinherit, "dlinherit"},
+  {threads, "threads"},
+  {futextest, "futex"},
+  {affinity, "affinity"},
+  {rusagetest, "rusage"},
+  {schedlattest, "schedlat"},
+  {fpvec, "fpvec"},
+  {usharedtest, "ushared"},
+  {batchtest, "batch"},
+  {lockstattest, "lockstat"},
+  {sharedread, "sharedread"},
+  {bcachegrow, "bcachegrow"},
+  {cachestattest, "cachestat"},
+  {diskqueue, "diskqueue"},
+  {readaheadtest, "readahead"},
+  {readaheadmany, "readaheadmany"},
 
   { 0, 0},
 };
@@ -36,3 +36,18 @@ entry("getpid");
 entry("sbrk");
 entry("sleep");
 entry("uptime");
+entry("sched_setattr");
+entry("sched_getattr");
+entry("sched_yield");
+entry("clone");
+entry("join");
+entry("futex");
+entry("sched_setaffinity");
+entry("sched_getaffinity");
+entry("getrusage");
+entry("wait4");
+entry("schedlat");
+entry("batch");
+entry("lockstat");
+entry("cachestat");
+entry("bcachelimit");